@@ -3,67 +3,107 @@
 
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <cstring>
 
-#include "cggeometries.hpp"
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
 
-static const float pi = M_PI;
-static const float half_pi = M_PI_2;
-static const float two_pi = 2 * M_PI;
+#include "cggeometries.hpp"
 
 namespace Cg {
 
-void quad(
-        QVector<float>& positions,
-        QVector<float>& normals,
-        QVector<float>& texCoords,
-        QVector<unsigned int>& indices,
-        int slices)
+namespace {
+
+/* Returns cos and sin of j / n * 2 pi for j = 0, ..., n, interleaved. Each
+ * table is computed once. The last entry repeats the first, so that circles
+ * close exactly. Other start angles follow from symmetry, e.g.
+ * cos(a - pi/2) = sin(a) and sin(a - pi/2) = -cos(a). */
+QVector<float> circleTable(int n)
+{
+    static QMutex mutex;
+    static QHash<int, QVector<float>> tables;
+    QMutexLocker locker(&mutex);
+    QVector<float>& table = tables[n];
+    if (table.isEmpty()) {
+        table.resize(2 * (n + 1));
+        for (int j = 0; j < n; j++) {
+            double a = j * (2.0 * M_PI / n);
+            table[2 * j + 0] = std::cos(a);
+            table[2 * j + 1] = std::sin(a);
+        }
+        table[2 * n + 0] = table[0];
+        table[2 * n + 1] = table[1];
+    }
+    return table;
+}
+
+/* Allocates the arrays of a geometry with the given number of vertices and triangles */
+void allocate(Geometry& g, int vertexCount, int triangleCount)
+{
+    g.positions.resize(3 * vertexCount);
+    g.normals.resize(3 * vertexCount);
+    g.texCoords.resize(2 * vertexCount);
+    g.indices.resize(3 * triangleCount);
+}
+
+/* Writes two triangles for each quad of a grid of (rows + 1) x (columns + 1)
+ * vertices that starts at vertex first, and returns the end of the output.
+ * Flipped triangles have the opposite orientation. */
+unsigned int* gridIndices(unsigned int* index, unsigned int first, int rows, int columns, bool flipped = false)
+{
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < columns; j++) {
+            unsigned int a = first + i * (columns + 1) + j; // (i, j)
+            unsigned int b = a + 1;                         // (i, j + 1)
+            unsigned int c = a + columns + 1;               // (i + 1, j)
+            unsigned int d = c + 1;                         // (i + 1, j + 1)
+            if (flipped) {
+                index[0] = a; index[1] = c; index[2] = b;
+                index[3] = b; index[4] = c; index[5] = d;
+            } else {
+                index[0] = a; index[1] = b; index[2] = c;
+                index[3] = b; index[4] = d; index[5] = c;
+            }
+            index += 6;
+        }
+    }
+    return index;
+}
+
+void generateQuad(Geometry& g, int slices)
 {
-    positions.clear();
-    normals.clear();
-    texCoords.clear();
-    indices.clear();
+    allocate(g, (slices + 1) * (slices + 1), 2 * slices * slices);
+    float* p = g.positions.data();
+    float* n = g.normals.data();
+    float* t = g.texCoords.data();
 
     for (int i = 0; i <= slices; i++) {
         float ty = i / (slices / 2.0f);
         for (int j = 0; j <= slices; j++) {
             float tx = j / (slices / 2.0f);
-            float x = -1.0f + tx;
-            float y = -1.0f + ty;
-            float z = 0.0f;
-            positions.append(x);
-            positions.append(y);
-            positions.append(z);
-            normals.append(0.0f);
-            normals.append(0.0f);
-            normals.append(1.0f);
-            texCoords.append(tx / 2.0f);
-            texCoords.append(ty / 2.0f);
-            if (i < slices && j < slices) {
-                indices.append((i + 0) * (slices + 1) + (j + 0));
-                indices.append((i + 0) * (slices + 1) + (j + 1));
-                indices.append((i + 1) * (slices + 1) + (j + 0));
-                indices.append((i + 0) * (slices + 1) + (j + 1));
-                indices.append((i + 1) * (slices + 1) + (j + 1));
-                indices.append((i + 1) * (slices + 1) + (j + 0));
-            }
+            *p++ = -1.0f + tx;
+            *p++ = -1.0f + ty;
+            *p++ = 0.0f;
+            *n++ = 0.0f;
+            *n++ = 0.0f;
+            *n++ = 1.0f;
+            *t++ = tx / 2.0f;
+            *t++ = ty / 2.0f;
         }
     }
+    gridIndices(g.indices.data(), 0, slices, slices);
 }
 
-void cube(
-        QVector<float>& positions,
-        QVector<float>& normals,
-        QVector<float>& texCoords,
-        QVector<unsigned int>& indices,
-        int slices)
+void generateCube(Geometry& g, int slices)
 {
-    positions.clear();
-    normals.clear();
-    texCoords.clear();
-    indices.clear();
-
     int verticesPerSide = (slices + 1) * (slices + 1);
+    allocate(g, 6 * verticesPerSide, 6 * 2 * slices * slices);
+    float* p = g.positions.data();
+    float* n = g.normals.data();
+    float* t = g.texCoords.data();
+    unsigned int* index = g.indices.data();
+
     for (int side = 0; side < 6; side++) {
         float nx, ny, nz;
         switch (side) {
@@ -135,40 +175,22 @@ void cube(
                     z = -1.0f + tx;
                     break;
                 }
-                positions.append(x);
-                positions.append(y);
-                positions.append(z);
-                normals.append(nx);
-                normals.append(ny);
-                normals.append(nz);
-                texCoords.append(tx / 2.0f);
-                texCoords.append(ty / 2.0f);
-                if (i < slices && j < slices) {
-                    indices.append(side * verticesPerSide + (i + 0) * (slices + 1) + (j + 0));
-                    indices.append(side * verticesPerSide + (i + 0) * (slices + 1) + (j + 1));
-                    indices.append(side * verticesPerSide + (i + 1) * (slices + 1) + (j + 0));
-                    indices.append(side * verticesPerSide + (i + 0) * (slices + 1) + (j + 1));
-                    indices.append(side * verticesPerSide + (i + 1) * (slices + 1) + (j + 1));
-                    indices.append(side * verticesPerSide + (i + 1) * (slices + 1) + (j + 0));
-                }
+                *p++ = x;
+                *p++ = y;
+                *p++ = z;
+                *n++ = nx;
+                *n++ = ny;
+                *n++ = nz;
+                *t++ = tx / 2.0f;
+                *t++ = ty / 2.0f;
             }
         }
+        index = gridIndices(index, side * verticesPerSide, slices, slices);
     }
 }
 
-void disk(
-        QVector<float>& positions,
-        QVector<float>& normals,
-        QVector<float>& texCoords,
-        QVector<unsigned int>& indices,
-        float innerRadius,
-        int slices)
+void generateDisk(Geometry& g, float innerRadius, int slices)
 {
-    positions.clear();
-    normals.clear();
-    texCoords.clear();
-    indices.clear();
-
     const int loops = 1;
 
     Q_ASSERT(innerRadius >= 0.0f);
@@ -176,206 +198,173 @@ void disk(
     Q_ASSERT(slices >= 4);
     Q_ASSERT(loops >= 1);
 
+    allocate(g, (loops + 1) * (slices + 1), 2 * loops * slices);
+    float* p = g.positions.data();
+    float* n = g.normals.data();
+    float* t = g.texCoords.data();
+    // alpha = tx * 2 pi + pi/2
+    const QVector<float> circle = circleTable(slices);
+
     for (int i = 0; i <= loops; i++) {
         float ty = static_cast<float>(i) / loops;
         float r = innerRadius + ty * (1.0f - innerRadius);
         for (int j = 0; j <= slices; j++) {
             float tx = static_cast<float>(j) / slices;
-            float alpha = tx * two_pi + half_pi;
-            positions.append(r * std::cos(alpha));
-            positions.append(r * std::sin(alpha));
-            positions.append(0.0f);
-            normals.append(0.0f);
-            normals.append(0.0f);
-            normals.append(1.0f);
-            texCoords.append(1.0f - tx);
-            texCoords.append(ty);
-            if (i < loops && j < slices) {
-                indices.append((i + 0) * (slices + 1) + (j + 0));
-                indices.append((i + 1) * (slices + 1) + (j + 0));
-                indices.append((i + 0) * (slices + 1) + (j + 1));
-                indices.append((i + 0) * (slices + 1) + (j + 1));
-                indices.append((i + 1) * (slices + 1) + (j + 0));
-                indices.append((i + 1) * (slices + 1) + (j + 1));
-            }
+            float cosalpha = -circle[2 * j + 1];
+            float sinalpha = circle[2 * j + 0];
+            *p++ = r * cosalpha;
+            *p++ = r * sinalpha;
+            *p++ = 0.0f;
+            *n++ = 0.0f;
+            *n++ = 0.0f;
+            *n++ = 1.0f;
+            *t++ = 1.0f - tx;
+            *t++ = ty;
         }
     }
+    gridIndices(g.indices.data(), 0, loops, slices, true);
 }
 
-void sphere(
-        QVector<float>& positions,
-        QVector<float>& normals,
-        QVector<float>& texCoords,
-        QVector<unsigned int>& indices,
-        int slices, int stacks)
+void generateSphere(Geometry& g, int slices, int stacks)
 {
-    positions.clear();
-    normals.clear();
-    texCoords.clear();
-    indices.clear();
-
     Q_ASSERT(slices >= 4);
     Q_ASSERT(stacks >= 2);
 
+    allocate(g, (stacks + 1) * (slices + 1), 2 * stacks * slices);
+    float* p = g.positions.data();
+    float* n = g.normals.data();
+    float* t = g.texCoords.data();
+    // lat = ty * pi, the first half of a circle with 2 * stacks segments
+    const QVector<float> latitudes = circleTable(2 * stacks);
+    // lon = tx * 2 pi - pi/2
+    const QVector<float> longitudes = circleTable(slices);
+
     for (int i = 0; i <= stacks; i++) {
         float ty = static_cast<float>(i) / stacks;
-        float lat = ty * pi;
+        float coslat = latitudes[2 * i + 0];
+        float sinlat = latitudes[2 * i + 1];
         for (int j = 0; j <= slices; j++) {
             float tx = static_cast<float>(j) / slices;
-            float lon = tx * two_pi - half_pi;
-            float sinlat = std::sin(lat);
-            float coslat = std::cos(lat);
-            float sinlon = std::sin(lon);
-            float coslon = std::cos(lon);
+            float coslon = longitudes[2 * j + 1];
+            float sinlon = -longitudes[2 * j + 0];
             float x = sinlat * coslon;
             float y = coslat;
             float z = sinlat * sinlon;
-            positions.append(x);
-            positions.append(y);
-            positions.append(z);
-            normals.append(x);
-            normals.append(y);
-            normals.append(z);
-            texCoords.append(1.0f - tx);
-            texCoords.append(1.0f - ty);
-            if (i < stacks && j < slices) {
-                indices.append((i + 0) * (slices + 1) + (j + 0));
-                indices.append((i + 0) * (slices + 1) + (j + 1));
-                indices.append((i + 1) * (slices + 1) + (j + 0));
-                indices.append((i + 0) * (slices + 1) + (j + 1));
-                indices.append((i + 1) * (slices + 1) + (j + 1));
-                indices.append((i + 1) * (slices + 1) + (j + 0));
-            }
+            *p++ = x;
+            *p++ = y;
+            *p++ = z;
+            *n++ = x;
+            *n++ = y;
+            *n++ = z;
+            *t++ = 1.0f - tx;
+            *t++ = 1.0f - ty;
         }
     }
+    gridIndices(g.indices.data(), 0, stacks, slices);
 }
 
-void cylinder(
-        QVector<float>& positions,
-        QVector<float>& normals,
-        QVector<float>& texCoords,
-        QVector<unsigned int>& indices,
-        int slices, int stacks)
+void generateCylinder(Geometry& g, int slices, int stacks)
 {
-    positions.clear();
-    normals.clear();
-    texCoords.clear();
-    indices.clear();
+    allocate(g, (stacks + 1) * (slices + 1), 2 * stacks * slices);
+    float* p = g.positions.data();
+    float* n = g.normals.data();
+    float* t = g.texCoords.data();
+    // alpha = tx * 2 pi - pi/2
+    const QVector<float> circle = circleTable(slices);
 
     for (int i = 0; i <= stacks; i++) {
         float ty = static_cast<float>(i) / stacks;
+        float y = -(ty * 2.0f - 1.0f);
         for (int j = 0; j <= slices; j++) {
             float tx = static_cast<float>(j) / slices;
-            float alpha = tx * two_pi - half_pi;
-            float x = std::cos(alpha);
-            float y = -(ty * 2.0f - 1.0f);
-            float z = std::sin(alpha);
-            positions.append(x);
-            positions.append(y);
-            positions.append(z);
-            normals.append(x);
-            normals.append(0);
-            normals.append(z);
-            texCoords.append(1.0f - tx);
-            texCoords.append(1.0f - ty);
-            if (i < stacks && j < slices) {
-                indices.append((i + 0) * (slices + 1) + (j + 0));
-                indices.append((i + 0) * (slices + 1) + (j + 1));
-                indices.append((i + 1) * (slices + 1) + (j + 0));
-                indices.append((i + 0) * (slices + 1) + (j + 1));
-                indices.append((i + 1) * (slices + 1) + (j + 1));
-                indices.append((i + 1) * (slices + 1) + (j + 0));
-            }
+            float x = circle[2 * j + 1];
+            float z = -circle[2 * j + 0];
+            *p++ = x;
+            *p++ = y;
+            *p++ = z;
+            *n++ = x;
+            *n++ = 0.0f;
+            *n++ = z;
+            *t++ = 1.0f - tx;
+            *t++ = 1.0f - ty;
         }
     }
+    gridIndices(g.indices.data(), 0, stacks, slices);
 }
 
-void cone(
-        QVector<float>& positions,
-        QVector<float>& normals,
-        QVector<float>& texCoords,
-        QVector<unsigned int>& indices,
-        int slices, int stacks)
+void generateCone(Geometry& g, int slices, int stacks)
 {
-    positions.clear();
-    normals.clear();
-    texCoords.clear();
-    indices.clear();
-
     Q_ASSERT(slices >= 4);
     Q_ASSERT(stacks >= 2);
 
+    allocate(g, (stacks + 1) * (slices + 1), 2 * stacks * slices);
+    float* p = g.positions.data();
+    float* n = g.normals.data();
+    float* t = g.texCoords.data();
+    // alpha = tx * 2 pi - pi/2
+    const QVector<float> circle = circleTable(slices);
+
     for (int i = 0; i <= stacks; i++) {
         float ty = static_cast<float>(i) / stacks;
+        float y = -(ty * 2.0f - 1.0f);
         for (int j = 0; j <= slices; j++) {
             float tx = static_cast<float>(j) / slices;
-            float alpha = tx * two_pi - half_pi;
-            float x = ty * std::cos(alpha);
-            float y = -(ty * 2.0f - 1.0f);
-            float z = ty * std::sin(alpha);
-            positions.append(x);
-            positions.append(y);
-            positions.append(z);
+            float x = ty * circle[2 * j + 1];
+            float z = ty * -circle[2 * j + 0];
+            *p++ = x;
+            *p++ = y;
+            *p++ = z;
             float nx = x;
             float ny = 0.5f;
             float nz = z;
             float nl = std::sqrt(nx * nx + ny * ny + nz * nz);
-            normals.append(nx / nl);
-            normals.append(ny / nl);
-            normals.append(nz / nl);
-            texCoords.append(1.0f - tx);
-            texCoords.append(1.0f - ty);
-            if (i < stacks && j < slices) {
-                indices.append((i + 0) * (slices + 1) + (j + 0));
-                indices.append((i + 0) * (slices + 1) + (j + 1));
-                indices.append((i + 1) * (slices + 1) + (j + 0));
-                indices.append((i + 0) * (slices + 1) + (j + 1));
-                indices.append((i + 1) * (slices + 1) + (j + 1));
-                indices.append((i + 1) * (slices + 1) + (j + 0));
-            }
+            *n++ = nx / nl;
+            *n++ = ny / nl;
+            *n++ = nz / nl;
+            *t++ = 1.0f - tx;
+            *t++ = 1.0f - ty;
         }
     }
+    gridIndices(g.indices.data(), 0, stacks, slices);
 }
 
-void torus(
-        QVector<float>& positions,
-        QVector<float>& normals,
-        QVector<float>& texCoords,
-        QVector<unsigned int>& indices,
-        float innerRadius,
-        int sides, int rings)
+void generateTorus(Geometry& g, float innerRadius, int sides, int rings)
 {
-    positions.clear();
-    normals.clear();
-    texCoords.clear();
-    indices.clear();
-
     Q_ASSERT(innerRadius >= 0.0f);
     Q_ASSERT(innerRadius < 1.0f);
     Q_ASSERT(sides >= 4);
     Q_ASSERT(rings >= 4);
 
+    allocate(g, (sides + 1) * (rings + 1), 2 * sides * rings);
+    float* p = g.positions.data();
+    float* n = g.normals.data();
+    float* t = g.texCoords.data();
+    // alpha = ty * 2 pi - pi/2
+    const QVector<float> sideCircle = circleTable(sides);
+    // beta = tx * 2 pi - pi
+    const QVector<float> ringCircle = circleTable(rings);
+
     float ringradius = (1.0f - innerRadius) / 2.0f;
     float ringcenter = innerRadius + ringradius;
 
     for (int i = 0; i <= sides; i++) {
         float ty = static_cast<float>(i) / sides;
-        float alpha = ty * two_pi - half_pi;
-        float c = std::cos(alpha);
-        float s = std::sin(alpha);
+        float c = sideCircle[2 * i + 1];
+        float s = -sideCircle[2 * i + 0];
         for (int j = 0; j <= rings; j++) {
             float tx = static_cast<float>(j) / rings;
-            float beta = tx * two_pi - pi;
+            float cosbeta = -ringCircle[2 * j + 0];
+            float sinbeta = -ringCircle[2 * j + 1];
 
-            float x = ringcenter + ringradius * std::cos(beta);
+            float x = ringcenter + ringradius * cosbeta;
             float y = 0.0f;
-            float z = ringradius * std::sin(beta);
+            float z = ringradius * sinbeta;
             float rx = c * x + s * y;
             float ry = c * y - s * x;
             float rz = z;
-            positions.append(rx);
-            positions.append(ry);
-            positions.append(rz);
+            *p++ = rx;
+            *p++ = ry;
+            *p++ = rz;
 
             float rcx = c * ringcenter;
             float rcy = - s * ringcenter;
@@ -384,22 +373,199 @@ void torus(
             float ny = ry - rcy;
             float nz = rz - rcz;
             float nl = std::sqrt(nx * nx + ny * ny + nz * nz);
-            normals.append(nx / nl);
-            normals.append(ny / nl);
-            normals.append(nz / nl);
-
-            texCoords.append(1.0f - tx);
-            texCoords.append(1.0f - ty);
-            if (i < sides && j < rings) {
-                indices.append((i + 0) * (rings + 1) + (j + 0));
-                indices.append((i + 0) * (rings + 1) + (j + 1));
-                indices.append((i + 1) * (rings + 1) + (j + 0));
-                indices.append((i + 0) * (rings + 1) + (j + 1));
-                indices.append((i + 1) * (rings + 1) + (j + 1));
-                indices.append((i + 1) * (rings + 1) + (j + 0));
-            }
+            *n++ = nx / nl;
+            *n++ = ny / nl;
+            *n++ = nz / nl;
+
+            *t++ = 1.0f - tx;
+            *t++ = 1.0f - ty;
         }
     }
+    gridIndices(g.indices.data(), 0, sides, rings);
+}
+
+enum Shape { QuadShape, CubeShape, DiskShape, SphereShape, CylinderShape, ConeShape, TorusShape };
+
+struct GeometryKey {
+    Shape shape;
+    int a, b;     // slices and stacks, or sides and rings
+    float radius; // inner radius of disk and torus
+};
+
+bool operator==(const GeometryKey& k0, const GeometryKey& k1)
+{
+    return k0.shape == k1.shape && k0.a == k1.a && k0.b == k1.b && k0.radius == k1.radius;
+}
+
+uint qHash(const GeometryKey& key, uint seed = 0)
+{
+    quint32 radius;
+    std::memcpy(&radius, &key.radius, sizeof(radius));
+    uint h = seed;
+    h = 31 * h + key.shape;
+    h = 31 * h + key.a;
+    h = 31 * h + key.b;
+    h = 31 * h + radius;
+    return h;
+}
+
+Geometry cachedGeometry(Shape shape, int a, int b = 0, float radius = 0.0f)
+{
+    static QMutex mutex;
+    static QHash<GeometryKey, Geometry> cache;
+    const GeometryKey key = { shape, a, b, radius };
+    QMutexLocker locker(&mutex);
+    auto it = cache.constFind(key);
+    if (it != cache.constEnd())
+        return it.value();
+
+    Geometry g;
+    switch (shape) {
+    case QuadShape:
+        generateQuad(g, a);
+        break;
+    case CubeShape:
+        generateCube(g, a);
+        break;
+    case DiskShape:
+        generateDisk(g, radius, a);
+        break;
+    case SphereShape:
+        generateSphere(g, a, b);
+        break;
+    case CylinderShape:
+        generateCylinder(g, a, b);
+        break;
+    case ConeShape:
+        generateCone(g, a, b);
+        break;
+    case TorusShape:
+        generateTorus(g, radius, a, b);
+        break;
+    }
+    cache.insert(key, g);
+    return g;
+}
+
+void assign(const Geometry& g,
+        QVector<float>& positions,
+        QVector<float>& normals,
+        QVector<float>& texCoords,
+        QVector<unsigned int>& indices)
+{
+    positions = g.positions;
+    normals = g.normals;
+    texCoords = g.texCoords;
+    indices = g.indices;
+}
+
+}
+
+Geometry quadGeometry(int slices)
+{
+    return cachedGeometry(QuadShape, slices);
+}
+
+Geometry cubeGeometry(int slices)
+{
+    return cachedGeometry(CubeShape, slices);
+}
+
+Geometry diskGeometry(float innerRadius, int slices)
+{
+    return cachedGeometry(DiskShape, slices, 0, innerRadius);
+}
+
+Geometry sphereGeometry(int slices, int stacks)
+{
+    return cachedGeometry(SphereShape, slices, stacks);
+}
+
+Geometry cylinderGeometry(int slices, int stacks)
+{
+    return cachedGeometry(CylinderShape, slices, stacks);
+}
+
+Geometry coneGeometry(int slices, int stacks)
+{
+    return cachedGeometry(ConeShape, slices, stacks);
+}
+
+Geometry torusGeometry(float innerRadius, int sides, int rings)
+{
+    return cachedGeometry(TorusShape, sides, rings, innerRadius);
+}
+
+void quad(
+        QVector<float>& positions,
+        QVector<float>& normals,
+        QVector<float>& texCoords,
+        QVector<unsigned int>& indices,
+        int slices)
+{
+    assign(quadGeometry(slices), positions, normals, texCoords, indices);
+}
+
+void cube(
+        QVector<float>& positions,
+        QVector<float>& normals,
+        QVector<float>& texCoords,
+        QVector<unsigned int>& indices,
+        int slices)
+{
+    assign(cubeGeometry(slices), positions, normals, texCoords, indices);
+}
+
+void disk(
+        QVector<float>& positions,
+        QVector<float>& normals,
+        QVector<float>& texCoords,
+        QVector<unsigned int>& indices,
+        float innerRadius,
+        int slices)
+{
+    assign(diskGeometry(innerRadius, slices), positions, normals, texCoords, indices);
+}
+
+void sphere(
+        QVector<float>& positions,
+        QVector<float>& normals,
+        QVector<float>& texCoords,
+        QVector<unsigned int>& indices,
+        int slices, int stacks)
+{
+    assign(sphereGeometry(slices, stacks), positions, normals, texCoords, indices);
+}
+
+void cylinder(
+        QVector<float>& positions,
+        QVector<float>& normals,
+        QVector<float>& texCoords,
+        QVector<unsigned int>& indices,
+        int slices, int stacks)
+{
+    assign(cylinderGeometry(slices, stacks), positions, normals, texCoords, indices);
+}
+
+void cone(
+        QVector<float>& positions,
+        QVector<float>& normals,
+        QVector<float>& texCoords,
+        QVector<unsigned int>& indices,
+        int slices, int stacks)
+{
+    assign(coneGeometry(slices, stacks), positions, normals, texCoords, indices);
+}
+
+void torus(
+        QVector<float>& positions,
+        QVector<float>& normals,
+        QVector<float>& texCoords,
+        QVector<unsigned int>& indices,
+        float innerRadius,
+        int sides, int rings)
+{
+    assign(torusGeometry(innerRadius, sides, rings), positions, normals, texCoords, indices);
 }
 
 }
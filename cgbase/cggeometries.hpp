@@ -74,6 +74,29 @@ void torus(
         float innerRadius = 0.4f,
         int sides = 40, int rings = 40);
 
+/* Geometry data in the form that Cg::VertexArray::create() and
+ * Cg::createVertexArrayObject() take. */
+struct Geometry {
+    QVector<float> positions;
+    QVector<float> normals;
+    QVector<float> texCoords;
+    QVector<unsigned int> indices;
+};
+
+/* The following functions return the same geometries as the functions above,
+ * from a cache that generates each combination of shape and parameters only
+ * once; the functions above use this cache, too. The data is implicitly
+ * shared with the cache, so that copies are cheap, e.g. for many instances of
+ * a glyph, and modifying a copy does not affect the cache.
+ * These functions can be called from any thread. */
+Geometry quadGeometry(int slices = 40);
+Geometry cubeGeometry(int slices = 40);
+Geometry diskGeometry(float innerRadius = 0.2f, int slices = 40);
+Geometry sphereGeometry(int slices = 40, int stacks = 20);
+Geometry cylinderGeometry(int slices = 40, int stacks = 20);
+Geometry coneGeometry(int slices = 40, int stacks = 20);
+Geometry torusGeometry(float innerRadius = 0.4f, int sides = 40, int rings = 40);
+
 }
 
 #endif
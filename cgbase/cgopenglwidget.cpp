@@ -6,6 +6,7 @@
 #include <QWheelEvent>
 
 #include "cgopenglwidget.hpp"
+#include "cgresources.hpp"
 
 
 namespace Cg {
@@ -34,6 +35,20 @@ OpenGLWidget::OpenGLWidget()
 
 OpenGLWidget::~OpenGLWidget()
 {
+#ifdef CG_HAVE_QVR
+    // Without a context the objects are gone already or will go with the context
+    if (!QOpenGLContext::currentContext())
+        return;
+    for (auto it = _viewTargets.begin(); it != _viewTargets.end(); ++it) {
+        for (int view = 0; view < it.value().size(); view++) {
+            ViewTarget& target = it.value()[view];
+            glDeleteFramebuffers(1, &target.fbo);
+            glDeleteTextures(1, &target.depthTex);
+            untrackResource(FramebufferResource, target.fbo);
+            untrackResource(TextureResource, target.depthTex);
+        }
+    }
+#endif
 }
 
 void OpenGLWidget::quit()
@@ -56,37 +71,44 @@ void OpenGLWidget::paintGL(const QMatrix4x4&, const QMatrix4x4&, int w, int h)
 }
 
 #ifdef CG_HAVE_QVR
-void OpenGLWidget::render(QVRWindow*, const QVRRenderContext& context, const unsigned int* textures)
+void OpenGLWidget::render(QVRWindow* window, const QVRRenderContext& context, const unsigned int* textures)
 {
-    static GLuint fbo = 0;
-    static GLuint depthTex = 0;
-
-    // initialize FBO once
-    if (fbo == 0)
-        glGenFramebuffers(1, &fbo);
-
-    // initialize depth tex once
-    if (depthTex == 0) {
-        glGenTextures(1, &depthTex);
-        glBindTexture(GL_TEXTURE_2D, depthTex);
+    // Each view of each window keeps its own framebuffer, so that nothing
+    // needs to be reallocated or reattached while the views stay the same
+    QVector<ViewTarget>& targets = _viewTargets[window];
+    for (int view = targets.size(); view < context.viewCount(); view++) {
+        ViewTarget target;
+        glGenFramebuffers(1, &target.fbo);
+        glGenTextures(1, &target.depthTex);
+        glBindTexture(GL_TEXTURE_2D, target.depthTex);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        target.colorTex = 0;
+        trackResource(FramebufferResource, target.fbo);
+        targets.append(target);
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-
     // Loop over the required views
     for (int view = 0; view < context.viewCount(); view++) {
+        ViewTarget& target = targets[view];
         // Get view dimensions
         int width = context.textureSize(view).width();
         int height = context.textureSize(view).height();
         // Set up framebuffer object to render into
-        glBindTexture(GL_TEXTURE_2D, depthTex);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height,
-                0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTex, 0);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[view], 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+        if (target.size != context.textureSize(view)) {
+            glBindTexture(GL_TEXTURE_2D, target.depthTex);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height,
+                    0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+            if (target.size.isEmpty())
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, target.depthTex, 0);
+            target.size = context.textureSize(view);
+            trackResource(TextureResource, target.depthTex, textureBytes(GL_DEPTH_COMPONENT24, width, height));
+        }
+        if (target.colorTex != textures[view]) {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[view], 0);
+            target.colorTex = textures[view];
+        }
         // Call the render function
         QMatrix4x4 P = context.frustum(view).toMatrix4x4();
         QMatrix4x4 V = context.viewMatrix(view);
@@ -7,6 +7,9 @@
 #include <QOpenGLExtraFunctions>
 
 #ifdef CG_HAVE_QVR
+# include <QHash>
+# include <QSize>
+# include <QVector>
 # include <qvr/app.hpp>
 #else
 # include <QOpenGLWidget>
@@ -39,6 +42,15 @@ Q_OBJECT
 private:
 #ifdef CG_HAVE_QVR
     bool _wantExit;
+    // The framebuffer of a view that render() draws into. The depth texture
+    // and the attachments only change when the view does.
+    struct ViewTarget {
+        GLuint fbo;
+        GLuint depthTex;
+        QSize size;          // of depthTex
+        GLuint colorTex;     // attached color texture
+    };
+    QHash<QVRWindow*, QVector<ViewTarget>> _viewTargets;
 #else
     QTimer _updateTimer;
 #endif
@@ -0,0 +1,259 @@
+/* Copyright (C) 2018 Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de> */
+
+#include <cstring>
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+
+#include "cgprograms.hpp"
+#include "cgtools.hpp"
+
+namespace Cg
+{
+
+namespace {
+
+/* A linked program in the binary format of the driver */
+struct ProgramBinary {
+    GLenum format;
+    QByteArray data;
+};
+
+/* Binaries that were loaded or created in this process, shared between the
+ * GUI thread and the background thread */
+struct ProgramCache {
+    QMutex mutex;
+    QHash<QByteArray, ProgramBinary> binaries;
+};
+
+ProgramCache& programCache()
+{
+    static ProgramCache cache;
+    return cache;
+}
+
+QString programCacheDir()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/programs";
+}
+
+QString programCacheFile(const QByteArray& key)
+{
+    return programCacheDir() + "/" + QString::fromLatin1(key) + ".bin";
+}
+
+bool programBinariesSupported()
+{
+    QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+    GLint formats = 0;
+    gl->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+/* A binary only fits the driver that created it, so the driver is part of the key */
+QByteArray programKey(const QString& vertexShaderCode, const QString& fragmentShaderCode)
+{
+    QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (GLenum s : strings) {
+        hash.addData(reinterpret_cast<const char*>(gl->glGetString(s)));
+        hash.addData("\n", 1);
+    }
+    hash.addData(vertexShaderCode.toUtf8());
+    hash.addData("\0", 1);
+    hash.addData(fragmentShaderCode.toUtf8());
+    return hash.result().toHex();
+}
+
+bool findBinary(const QByteArray& key, ProgramBinary& binary)
+{
+    ProgramCache& cache = programCache();
+    {
+        QMutexLocker locker(&cache.mutex);
+        auto it = cache.binaries.constFind(key);
+        if (it != cache.binaries.constEnd()) {
+            binary = it.value();
+            return true;
+        }
+    }
+
+    // A cache file holds the binary format followed by the binary
+    QFile file(programCacheFile(key));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray data = file.readAll();
+    quint32 format;
+    if (data.size() <= int(sizeof(format)))
+        return false;
+    std::memcpy(&format, data.constData(), sizeof(format));
+    binary.format = format;
+    binary.data = data.mid(sizeof(format));
+    QMutexLocker locker(&cache.mutex);
+    cache.binaries.insert(key, binary);
+    return true;
+}
+
+void storeBinary(const QByteArray& key, const ProgramBinary& binary)
+{
+    ProgramCache& cache = programCache();
+    {
+        QMutexLocker locker(&cache.mutex);
+        cache.binaries.insert(key, binary);
+    }
+
+    // QSaveFile replaces the file atomically, so concurrent writers and
+    // readers of the same program never see a partial binary
+    QDir().mkpath(programCacheDir());
+    QSaveFile file(programCacheFile(key));
+    quint32 format = binary.format;
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        file.write(binary.data);
+        file.commit();
+    }
+}
+
+/* Compiles and links a program from source. If key is not empty, the
+ * binary of the program is added to the cache. */
+bool compileProgram(QOpenGLShaderProgram& prg,
+        const QString& vertexShaderCode, const QString& fragmentShaderCode,
+        const QByteArray& key)
+{
+    QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+    if (!prg.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderCode)
+            || !prg.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderCode))
+        return false;
+    if (!key.isEmpty())
+        gl->glProgramParameteri(prg.programId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    if (!prg.link())
+        return false;
+
+    if (!key.isEmpty()) {
+        GLint length = 0;
+        gl->glGetProgramiv(prg.programId(), GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length > 0) {
+            ProgramBinary binary;
+            binary.data.resize(length);
+            gl->glGetProgramBinary(prg.programId(), length, nullptr, &binary.format, binary.data.data());
+            storeBinary(key, binary);
+        }
+    }
+    return true;
+}
+
+/* Compiles programs into the cache with its own context, which must share
+ * with the context of the GUI thread. Contexts can only be made current on
+ * the thread they belong to, so the context is moved here and back. */
+class ProgramThread : public QThread
+{
+public:
+    QOpenGLContext* context;
+    QOffscreenSurface* surface;
+    QList<QPair<QString, QString>> programs;
+
+protected:
+    void run() override
+    {
+        if (context->makeCurrent(surface)) {
+            for (int i = 0; i < programs.size(); i++) {
+                QString vertexShaderCode = prependGLSLVersion(loadFile(programs[i].first));
+                QString fragmentShaderCode = prependGLSLVersion(loadFile(programs[i].second));
+                QByteArray key = programKey(vertexShaderCode, fragmentShaderCode);
+                ProgramBinary binary;
+                if (!findBinary(key, binary)) {
+                    QOpenGLShaderProgram prg;
+                    compileProgram(prg, vertexShaderCode, fragmentShaderCode, key);
+                }
+            }
+            context->doneCurrent();
+        }
+        context->moveToThread(QCoreApplication::instance()->thread());
+    }
+};
+
+ProgramThread* programThread = nullptr;
+
+void waitForProgramThread()
+{
+    if (programThread)
+        programThread->wait();
+}
+
+}
+
+bool buildProgram(QOpenGLShaderProgram& prg,
+        const QString& vertexShaderFile, const QString& fragmentShaderFile)
+{
+    QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+    QString vertexShaderCode = prependGLSLVersion(loadFile(vertexShaderFile));
+    QString fragmentShaderCode = prependGLSLVersion(loadFile(fragmentShaderFile));
+    QByteArray key;
+    if (programBinariesSupported()) {
+        key = programKey(vertexShaderCode, fragmentShaderCode);
+        ProgramBinary binary;
+        if (findBinary(key, binary)) {
+            prg.create();
+            gl->glProgramBinary(prg.programId(), binary.format, binary.data.constData(), binary.data.size());
+            GLint linked = 0;
+            gl->glGetProgramiv(prg.programId(), GL_LINK_STATUS, &linked);
+            // Without shaders, link() only takes over the state of the binary
+            if (linked && prg.link())
+                return true;
+            // The driver rejected the binary; discard the error it may have
+            // raised and fall back to the source
+            gl->glGetError();
+        }
+    }
+    return compileProgram(prg, vertexShaderCode, fragmentShaderCode, key);
+}
+
+void prepareProgramsInBackground(const QList<QPair<QString, QString>>& programs)
+{
+    QOpenGLContext* current = QOpenGLContext::currentContext();
+    if (programs.isEmpty() || !programBinariesSupported())
+        return;
+
+    // Only one thread at a time; a previous one is usually long done
+    if (programThread) {
+        programThread->wait();
+    } else {
+        qAddPostRoutine(waitForProgramThread);
+    }
+
+    ProgramThread* thread = new ProgramThread;
+    thread->programs = programs;
+    thread->surface = new QOffscreenSurface;
+    thread->surface->setFormat(current->format());
+    thread->surface->create();
+    thread->context = new QOpenGLContext;
+    thread->context->setFormat(current->format());
+    thread->context->setShareContext(current);
+    thread->context->create();
+    thread->context->moveToThread(thread);
+
+    // Clean up on the GUI thread, where the surface was created
+    QObject::connect(thread, &QThread::finished, QCoreApplication::instance(), [thread]() {
+        delete thread->context;
+        delete thread->surface;
+        if (programThread == thread)
+            programThread = nullptr;
+        delete thread;
+    });
+    programThread = thread;
+    thread->start(QThread::LowPriority);
+}
+
+}
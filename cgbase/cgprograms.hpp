@@ -0,0 +1,33 @@
+/* Copyright (C) 2018 Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de> */
+
+#ifndef CGPROGRAMS_HPP
+#define CGPROGRAMS_HPP
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QOpenGLShaderProgram>
+
+namespace Cg
+{
+
+/* Build a program from a vertex and a fragment shader file, both with
+ * prependGLSLVersion() applied. Linked programs are kept as driver binaries
+ * in a cache on disk, keyed by the shader sources and the OpenGL vendor,
+ * renderer and version, so that later builds skip compiling. If the driver
+ * rejects a cached binary, the program is compiled from source.
+ * Returns whether the program is linked. Needs a current OpenGL context. */
+bool buildProgram(QOpenGLShaderProgram& prg,
+        const QString& vertexShaderFile, const QString& fragmentShaderFile);
+
+/* Compile programs, given as pairs of vertex and fragment shader files, into
+ * the cache on a background thread with an OpenGL context that shares with
+ * the current one. Use this for programs that are not needed for the first
+ * frame; buildProgram() then only loads their binaries.
+ * Must be called from the GUI thread with a current OpenGL context. */
+void prepareProgramsInBackground(const QList<QPair<QString, QString>>& programs);
+
+}
+
+#endif
@@ -0,0 +1,135 @@
+/* Copyright (C) 2018 Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de> */
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include "cgresources.hpp"
+
+namespace Cg
+{
+
+namespace {
+
+struct ResourceTracker {
+    QMutex mutex;
+    QHash<unsigned int, qint64> objects[ResourceCategoryCount]; // name -> bytes
+    qint64 bytes[ResourceCategoryCount] = { 0, 0, 0, 0 };
+};
+
+ResourceTracker& tracker()
+{
+    static ResourceTracker t;
+    return t;
+}
+
+}
+
+void trackResource(ResourceCategory category, unsigned int name, qint64 bytes)
+{
+    if (name == 0)
+        return;
+    ResourceTracker& t = tracker();
+    QMutexLocker locker(&t.mutex);
+    auto it = t.objects[category].find(name);
+    if (it != t.objects[category].end()) {
+        t.bytes[category] += bytes - it.value();
+        it.value() = bytes;
+    } else {
+        t.objects[category].insert(name, bytes);
+        t.bytes[category] += bytes;
+    }
+}
+
+void untrackResource(ResourceCategory category, unsigned int name)
+{
+    ResourceTracker& t = tracker();
+    QMutexLocker locker(&t.mutex);
+    auto it = t.objects[category].find(name);
+    if (it != t.objects[category].end()) {
+        t.bytes[category] -= it.value();
+        t.objects[category].erase(it);
+    }
+}
+
+int trackedResourceCount(ResourceCategory category)
+{
+    ResourceTracker& t = tracker();
+    QMutexLocker locker(&t.mutex);
+    return t.objects[category].size();
+}
+
+qint64 trackedResourceBytes(ResourceCategory category)
+{
+    ResourceTracker& t = tracker();
+    QMutexLocker locker(&t.mutex);
+    return t.bytes[category];
+}
+
+qint64 textureBytes(GLenum internalFormat, int width, int height, bool mipmaps)
+{
+    int bytesPerTexel;
+    switch (internalFormat) {
+    case GL_R8:
+        bytesPerTexel = 1;
+        break;
+    case GL_RG8:
+    case GL_R16F:
+        bytesPerTexel = 2;
+        break;
+    case GL_RGB8:
+    case GL_DEPTH_COMPONENT24:
+        bytesPerTexel = 3;
+        break;
+    case GL_RG16F:
+    case GL_R32F:
+    case GL_RGBA8:
+    case GL_DEPTH_COMPONENT32F:
+    case GL_DEPTH24_STENCIL8:
+        bytesPerTexel = 4;
+        break;
+    case GL_RGBA16F:
+    case GL_RG32F:
+        bytesPerTexel = 8;
+        break;
+    case GL_RGB32F:
+        bytesPerTexel = 12;
+        break;
+    case GL_RGBA32F:
+        bytesPerTexel = 16;
+        break;
+    default:
+        bytesPerTexel = 4;
+        break;
+    }
+    qint64 bytes = qint64(width) * height * bytesPerTexel;
+    // the mipmap levels add up to a third of the base level
+    return mipmaps ? bytes * 4 / 3 : bytes;
+}
+
+QString resourceReport()
+{
+    static const char* names[ResourceCategoryCount] = {
+        "textures", "buffers", "vertex arrays", "framebuffers"
+    };
+    QString report = "GL resources:";
+    qint64 total = 0;
+    for (int c = 0; c < ResourceCategoryCount; c++) {
+        qint64 bytes = trackedResourceBytes(static_cast<ResourceCategory>(c));
+        report += QString(" %1 %2").arg(trackedResourceCount(static_cast<ResourceCategory>(c))).arg(names[c]);
+        if (c == TextureResource || c == BufferResource)
+            report += QString(" (%1 MiB)").arg(bytes / 1048576.0, 0, 'f', 1);
+        report += (c < ResourceCategoryCount - 1 ? "," : ";");
+        total += bytes;
+    }
+    report += QString(" %1 MiB in total").arg(total / 1048576.0, 0, 'f', 1);
+    return report;
+}
+
+void reportResources()
+{
+    qInfo("%s", qPrintable(resourceReport()));
+}
+
+}
@@ -0,0 +1,49 @@
+/* Copyright (C) 2018 Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de> */
+
+#ifndef CGRESOURCES_HPP
+#define CGRESOURCES_HPP
+
+#include <QString>
+#include <QOpenGLExtraFunctions>
+
+namespace Cg
+{
+
+/* Bookkeeping of OpenGL objects and their estimated memory, to find leaks
+ * and to check memory budgets. Only objects that are registered with
+ * trackResource() are counted; the functions in cgbase do that for the
+ * objects they create. All functions can be called from any thread. */
+
+enum ResourceCategory {
+    TextureResource,
+    BufferResource,
+    VertexArrayResource,
+    FramebufferResource,
+    ResourceCategoryCount
+};
+
+/* Record that an object was created, or that its storage changed, with the
+ * given estimated size in bytes. Registering a name again replaces its size. */
+void trackResource(ResourceCategory category, unsigned int name, qint64 bytes = 0);
+
+/* Record that an object was deleted. Unknown names are ignored. */
+void untrackResource(ResourceCategory category, unsigned int name);
+
+/* The number of live objects and their estimated bytes in a category */
+int trackedResourceCount(ResourceCategory category);
+qint64 trackedResourceBytes(ResourceCategory category);
+
+/* Estimate the size of a 2D texture level with the given internal format,
+ * optionally including all mipmap levels below it */
+qint64 textureBytes(GLenum internalFormat, int width, int height, bool mipmaps = false);
+
+/* A summary of live objects and bytes per category */
+QString resourceReport();
+
+/* Print resourceReport(). Cg::init() registers this to run at exit. */
+void reportResources();
+
+}
+
+#endif
@@ -2,28 +2,42 @@
  * Written by Martin Lambers <martin.lambers@uni-siegen.de> */
 
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
 
-#include <QTemporaryFile>
 #include <QOpenGLExtraFunctions>
 #include <QImage>
 #include <QFile>
+#include <QDir>
 #include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QCryptographicHash>
 #include <QTextStream>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QAtomicInt>
 
 #ifdef CG_HAVE_QVR
 # include <qvr/manager.hpp>
 #endif
 
-#include "tiny_obj_loader.h"
-
 #include "cgtools.hpp"
+#include "cgresources.hpp"
+#include "cgvertexarray.hpp"
 
 namespace Cg
 {
 
 void init(int& argc, char* argv[], OpenGLWidget* widget)
 {
+    // Report GL objects that are still alive at exit
+    qAddPostRoutine(reportResources);
+
     // Start the application, either via QVR or standalone
 #ifdef CG_HAVE_QVR
     QVRManager* manager = new QVRManager(argc, argv);
@@ -37,117 +51,436 @@ void init(int& argc, char* argv[], OpenGLWidget* widget)
 #endif
 }
 
-bool loadObj(const QString& fileName,
-        QVector<float>& positions,
-        QVector<float>& normals,
-        QVector<float>& texCoords,
-        QVector<unsigned int>& indices)
+namespace {
+
+/* A corner of a triangle in an OBJ file: indices of the position, the texture
+ * coordinate and the normal. Relative indices cannot be resolved before the
+ * number of elements in the preceding chunks is known, so they are stored
+ * relative to the start of the chunk. */
+struct ObjCorner {
+    enum { V = 1, VT = 2, VN = 4 };
+    int index[3];          // v, vt, vn; zero-based
+    unsigned char present; // V, VT and VN bits
+    unsigned char relative;
+};
+
+/* The parsed contents of a chunk of whole lines of an OBJ file */
+struct ObjChunk {
+    QVector<float> positions;
+    QVector<float> normals;
+    QVector<float> texCoords;
+    QVector<ObjCorner> corners; // three per triangle
+    int errorLine;              // line number within the chunk, or -1
+};
+
+bool isObjSpace(char c)
 {
-    // Handle special case: if the file is a Qt resource (name begins with ':'),
-    // then tiny_obj_loader cannot handle it, so we write the data to a temporary
-    // file first. The createNativeFile() function returns 0 if the file is already
-    // native.
-    QString plainFileName;
-    QTemporaryFile* tmpFile = QTemporaryFile::createNativeFile(fileName);
-    if (tmpFile) {
-        QFileInfo tmpFileInfo(*tmpFile);
-        plainFileName = tmpFileInfo.filePath();
-    } else {
-        plainFileName = fileName;
-    }
+    return c == ' ' || c == '\t' || c == '\r';
+}
 
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string errMsg;
+const char* skipObjSpace(const char* p, const char* end)
+{
+    while (p < end && isObjSpace(*p))
+        p++;
+    return p;
+}
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &errMsg, qPrintable(plainFileName), nullptr)) {
-        if (!errMsg.empty() && errMsg.back() == '\n')
-            errMsg.back() = '\0';
-        qCritical("Failed to load %s: %s", qPrintable(plainFileName), errMsg.c_str());
+/* Parse an integer without skipping white space first */
+bool parseObjInt(const char*& p, const char* end, int& value)
+{
+    const char* q = p;
+    bool negative = false;
+    if (q < end && (*q == '-' || *q == '+'))
+        negative = (*q++ == '-');
+    if (q == end || *q < '0' || *q > '9')
         return false;
+    long long v = 0;
+    while (q < end && *q >= '0' && *q <= '9' && v <= std::numeric_limits<int>::max())
+        v = 10 * v + (*q++ - '0');
+    if (v > std::numeric_limits<int>::max())
+        return false;
+    value = negative ? -int(v) : int(v);
+    p = q;
+    return true;
+}
+
+/* Parse a floating point number independently of the locale */
+bool parseObjFloat(const char*& p, const char* end, float& value)
+{
+    const char* q = skipObjSpace(p, end);
+    bool negative = false;
+    if (q < end && (*q == '-' || *q == '+'))
+        negative = (*q++ == '-');
+    double mantissa = 0.0;
+    int exponent = 0;
+    bool digits = false;
+    for (; q < end && *q >= '0' && *q <= '9'; q++, digits = true)
+        mantissa = 10.0 * mantissa + (*q - '0');
+    if (q < end && *q == '.') {
+        for (q++; q < end && *q >= '0' && *q <= '9'; q++, digits = true) {
+            mantissa = 10.0 * mantissa + (*q - '0');
+            exponent--;
+        }
     }
-    if (shapes.size() == 0) {
-        qCritical("No shapes in %s", qPrintable(plainFileName));
+    if (!digits)
         return false;
+    if (q < end && (*q == 'e' || *q == 'E')) {
+        const char* r = q + 1;
+        int e;
+        if (parseObjInt(r, end, e)) {
+            exponent += e;
+            q = r;
+        }
     }
+    value = (negative ? -1.0 : 1.0) * mantissa * std::pow(10.0, exponent);
+    p = q;
+    return true;
+}
 
+/* Parse the whole lines in [begin, end). Faces with more than three corners
+ * are triangulated as fans. Lines other than v, vt, vn and f are ignored.
+ * Elements are appended one by one: appending a braced list would build a
+ * temporary QVector for each line. */
+void parseObjChunk(const char* begin, const char* end, ObjChunk& chunk)
+{
+    chunk.errorLine = -1;
+    QVector<ObjCorner> face;
+    int line = 0;
+    for (const char* p = begin; p < end; line++) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!lineEnd)
+            lineEnd = end;
+        const char* q = skipObjSpace(p, lineEnd);
+        bool ok = true;
+        if (lineEnd - q > 1 && q[0] == 'v' && isObjSpace(q[1])) {
+            float x, y, z;
+            q += 2;
+            ok = parseObjFloat(q, lineEnd, x) && parseObjFloat(q, lineEnd, y) && parseObjFloat(q, lineEnd, z);
+            chunk.positions.append(x);
+            chunk.positions.append(y);
+            chunk.positions.append(z);
+        } else if (lineEnd - q > 2 && q[0] == 'v' && q[1] == 'n' && isObjSpace(q[2])) {
+            float x, y, z;
+            q += 3;
+            ok = parseObjFloat(q, lineEnd, x) && parseObjFloat(q, lineEnd, y) && parseObjFloat(q, lineEnd, z);
+            chunk.normals.append(x);
+            chunk.normals.append(y);
+            chunk.normals.append(z);
+        } else if (lineEnd - q > 2 && q[0] == 'v' && q[1] == 't' && isObjSpace(q[2])) {
+            float u, v = 0.0f;
+            q += 3;
+            ok = parseObjFloat(q, lineEnd, u);
+            parseObjFloat(q, lineEnd, v);
+            chunk.texCoords.append(u);
+            chunk.texCoords.append(v);
+        } else if (lineEnd - q > 1 && q[0] == 'f' && isObjSpace(q[1])) {
+            const int counts[3] = { chunk.positions.size() / 3, chunk.texCoords.size() / 2, chunk.normals.size() / 3 };
+            face.clear();
+            q = skipObjSpace(q + 1, lineEnd);
+            while (ok && q < lineEnd) {
+                // v, v/vt, v//vn or v/vt/vn
+                ObjCorner c = { { 0, 0, 0 }, 0, 0 };
+                for (int k = 0; k < 3 && ok; k++) {
+                    if (k > 0) {
+                        if (q == lineEnd || *q != '/')
+                            break;
+                        q++;
+                        if (k == 1 && q < lineEnd && *q == '/')
+                            continue;
+                    }
+                    int value;
+                    ok = parseObjInt(q, lineEnd, value) && value != 0;
+                    if (ok) {
+                        c.present |= (1 << k);
+                        if (value < 0) {
+                            c.relative |= (1 << k);
+                            c.index[k] = counts[k] + value;
+                        } else {
+                            c.index[k] = value - 1;
+                        }
+                    }
+                }
+                ok = ok && (q == lineEnd || isObjSpace(*q));
+                face.append(c);
+                q = skipObjSpace(q, lineEnd);
+            }
+            ok = ok && face.size() >= 3;
+            for (int k = 1; ok && k < face.size() - 1; k++) {
+                chunk.corners.append(face[0]);
+                chunk.corners.append(face[k]);
+                chunk.corners.append(face[k + 1]);
+            }
+        }
+        if (!ok) {
+            chunk.errorLine = line;
+            return;
+        }
+        p = lineEnd + 1;
+    }
+}
+
+struct ObjVertexKey {
+    int v, vt, vn;
+    bool operator==(const ObjVertexKey& k) const { return v == k.v && vt == k.vt && vn == k.vn; }
+};
+
+struct ObjVertexKeyHash {
+    size_t operator()(const ObjVertexKey& k) const
+    {
+        size_t h = std::hash<int>()(k.v);
+        h = h * 31 + std::hash<int>()(k.vt);
+        return h * 31 + std::hash<int>()(k.vn);
+    }
+};
+
+}
+
+bool loadObj(const QByteArray& data,
+        QVector<float>& positions,
+        QVector<float>& normals,
+        QVector<float>& texCoords,
+        QVector<unsigned int>& indices)
+{
     positions.clear();
     normals.clear();
     texCoords.clear();
     indices.clear();
 
-    bool ok = true;
+    // Parse chunks of about a megabyte of whole lines in parallel
+    const char* begin = data.constData();
+    const char* end = begin + data.size();
+    const qint64 chunkSize = 1 << 20;
+    QVector<const char*> chunkStarts;
+    for (const char* p = begin; p < end; ) {
+        chunkStarts.append(p);
+        const char* q = p + std::min(chunkSize, qint64(end - p));
+        const char* lineEnd = static_cast<const char*>(std::memchr(q, '\n', end - q));
+        p = lineEnd ? lineEnd + 1 : end;
+    }
+    chunkStarts.append(end);
+    int chunkCount = chunkStarts.size() - 1;
+    QVector<ObjChunk> chunks(chunkCount);
+    parallelFor(chunkCount, [&](int b, int e) {
+        for (int i = b; i < e; i++)
+            parseObjChunk(chunkStarts[i], chunkStarts[i + 1], chunks[i]);
+    });
+    for (int i = 0; i < chunkCount; i++) {
+        if (chunks[i].errorLine >= 0) {
+            int line = std::count(begin, chunkStarts[i], '\n') + chunks[i].errorLine + 1;
+            qCritical("Invalid OBJ data in line %d", line);
+            return false;
+        }
+    }
+
+    // Concatenate the elements and resolve the corners to vertices, in file
+    // order. Each combination of position, texture coordinate and normal
+    // becomes one vertex.
+    QVector<float> allPositions, allNormals, allTexCoords;
+    QVector<int> bases(3 * chunkCount);
+    int cornerCount = 0;
+    for (int i = 0; i < chunkCount; i++) {
+        bases[3 * i + 0] = allPositions.size() / 3;
+        bases[3 * i + 1] = allTexCoords.size() / 2;
+        bases[3 * i + 2] = allNormals.size() / 3;
+        allPositions.append(chunks[i].positions);
+        allTexCoords.append(chunks[i].texCoords);
+        allNormals.append(chunks[i].normals);
+        cornerCount += chunks[i].corners.size();
+    }
+    if (cornerCount == 0) {
+        qCritical("No faces in OBJ data");
+        return false;
+    }
+    const int counts[3] = { allPositions.size() / 3, allTexCoords.size() / 2, allNormals.size() / 3 };
+
     bool haveNormals = true;
     bool haveTexCoords = true;
-    std::map<std::tuple<int, int, int>, unsigned int> indexTupleMap;
-    for (size_t i = 0; ok && i < shapes.size(); i++) {
-        for (size_t j = 0; ok && j < shapes[i].mesh.indices.size(); j++) {
-            tinyobj::index_t index = shapes[i].mesh.indices[j];
-            int vertexIndex = index.vertex_index;
-            int normalIndex = index.normal_index;
-            if (normalIndex < 0)
-                haveNormals = false;
-            int texCoordIndex = index.texcoord_index;
-            if (texCoordIndex < 0)
-                haveTexCoords = false;
-            std::tuple<int, int, int> indexTuple = std::make_tuple(vertexIndex, normalIndex, texCoordIndex);
-            std::map<std::tuple<int, int, int>, unsigned int>::iterator it = indexTupleMap.find(indexTuple);
-            if (it == indexTupleMap.end()) {
-                unsigned int newIndex = indexTupleMap.size();
-                if (newIndex == std::numeric_limits<unsigned int>::max()) {
-                    qCritical("More vertices than I can handle in %s", qPrintable(plainFileName));
-                    ok = false;
-                    break;
-                }
-                positions.append(attrib.vertices[3 * vertexIndex + 0]);
-                positions.append(attrib.vertices[3 * vertexIndex + 1]);
-                positions.append(attrib.vertices[3 * vertexIndex + 2]);
-                if (haveNormals) {
-                    normals.append(attrib.normals[3 * normalIndex + 0]);
-                    normals.append(attrib.normals[3 * normalIndex + 1]);
-                    normals.append(attrib.normals[3 * normalIndex + 2]);
-                }
-                if (haveTexCoords) {
-                    texCoords.append(attrib.texcoords[2 * texCoordIndex + 0]);
-                    texCoords.append(attrib.texcoords[2 * texCoordIndex + 1]);
+    std::unordered_map<ObjVertexKey, unsigned int, ObjVertexKeyHash> vertices;
+    vertices.reserve(cornerCount);
+    indices.reserve(cornerCount);
+    for (int i = 0; i < chunkCount; i++) {
+        for (const ObjCorner& c : chunks[i].corners) {
+            int index[3] = { -1, -1, -1 };
+            for (int k = 0; k < 3; k++) {
+                if (!(c.present & (1 << k)))
+                    continue;
+                index[k] = c.index[k] + ((c.relative & (1 << k)) ? bases[3 * i + k] : 0);
+                if (index[k] < 0 || index[k] >= counts[k]) {
+                    qCritical("Invalid index in OBJ data");
+                    positions.clear();
+                    normals.clear();
+                    texCoords.clear();
+                    indices.clear();
+                    return false;
                 }
+            }
+            if (index[0] < 0) {
+                qCritical("Face corner without position in OBJ data");
+                positions.clear();
+                normals.clear();
+                texCoords.clear();
+                indices.clear();
+                return false;
+            }
+            haveTexCoords = haveTexCoords && index[1] >= 0;
+            haveNormals = haveNormals && index[2] >= 0;
+            ObjVertexKey key = { index[0], index[1], index[2] };
+            auto it = vertices.find(key);
+            if (it == vertices.end()) {
+                unsigned int newIndex = vertices.size();
+                for (int j = 0; j < 3; j++)
+                    positions.append(allPositions[3 * index[0] + j]);
+                if (haveTexCoords)
+                    for (int j = 0; j < 2; j++)
+                        texCoords.append(allTexCoords[2 * index[1] + j]);
+                if (haveNormals)
+                    for (int j = 0; j < 3; j++)
+                        normals.append(allNormals[3 * index[2] + j]);
+                vertices.insert(std::make_pair(key, newIndex));
                 indices.append(newIndex);
-                indexTupleMap.insert(std::make_pair(indexTuple, newIndex));
             } else {
                 indices.append(it->second);
             }
         }
     }
-    if (!ok) {
-        positions.clear();
-        normals.clear();
-        texCoords.clear();
-        indices.clear();
-    } else {
-        if (!haveNormals) {
-            normals = createNormals(positions, indices);
-        }
-        if (!haveTexCoords) {
-            texCoords.resize(positions.size() / 3 * 2);
-            for (int i = 0; i < texCoords.size(); i++)
-                texCoords[i] = 0.0f;
-        }
+
+    if (!haveNormals) {
+        normals = createNormals(positions, indices);
+    }
+    if (!haveTexCoords) {
+        texCoords.resize(positions.size() / 3 * 2);
+        for (int i = 0; i < texCoords.size(); i++)
+            texCoords[i] = 0.0f;
     }
-    return ok;
+    return true;
 }
 
-bool loadIntoTexture(const QString& fileName, GLenum target, bool mirrorY)
+bool loadObj(QIODevice* device,
+        QVector<float>& positions,
+        QVector<float>& normals,
+        QVector<float>& texCoords,
+        QVector<unsigned int>& indices)
 {
-    QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+    if (!device->isOpen() && !device->open(QIODevice::ReadOnly)) {
+        qCritical("Cannot open OBJ device: %s", qPrintable(device->errorString()));
+        return false;
+    }
+    return loadObj(device->readAll(), positions, normals, texCoords, indices);
+}
 
-    QImage img;
-    if (!img.load(fileName))
+bool loadObj(const QString& fileName,
+        QVector<float>& positions,
+        QVector<float>& normals,
+        QVector<float>& texCoords,
+        QVector<unsigned int>& indices)
+{
+    // QFile also handles Qt resources (names beginning with ':')
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCritical("Failed to load %s: %s", qPrintable(fileName), qPrintable(file.errorString()));
+        return false;
+    }
+    if (!loadObj(&file, positions, normals, texCoords, indices)) {
+        qCritical("Failed to load %s", qPrintable(fileName));
         return false;
+    }
+    return true;
+}
+
+namespace {
+
+QString textureCacheFile(const QByteArray& encoded, bool mirrorY)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(encoded);
+    hash.addData(mirrorY ? "m" : "n", 1);
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+        + "/textures/" + QString::fromLatin1(hash.result().toHex()) + ".rgba";
+}
+
+/* A cache file holds the width and the height followed by the pixels. The
+ * lines of RGBA8888 images are 32-bit aligned already, so they have no
+ * padding and the pixels can be read and written in one piece. */
+QImage readTextureCache(const QString& cacheFile)
+{
+    QFile file(cacheFile);
+    quint32 size[2];
+    if (!file.open(QIODevice::ReadOnly)
+            || file.read(reinterpret_cast<char*>(size), sizeof(size)) != sizeof(size)
+            || size[0] == 0 || size[1] == 0)
+        return QImage();
+    qint64 bytes = qint64(size[0]) * size[1] * 4;
+    if (file.size() != qint64(sizeof(size)) + bytes)
+        return QImage();
+    QImage img(size[0], size[1], QImage::Format_RGBA8888);
+    if (img.isNull() || file.read(reinterpret_cast<char*>(img.bits()), bytes) != bytes)
+        return QImage();
+    return img;
+}
+
+/* The cache never grows beyond this; the oldest files are removed first */
+const qint64 textureCacheBudget = qint64(512) << 20;
+
+void trimTextureCache(const QString& cacheDir, const QString& keepFile)
+{
+    QFileInfoList files = QDir(cacheDir).entryInfoList(QStringList("*.rgba"),
+            QDir::Files, QDir::Time | QDir::Reversed);
+    QString keep = QFileInfo(keepFile).absoluteFilePath();
+    qint64 usage = 0;
+    for (const QFileInfo& info : files)
+        usage += info.size();
+    for (int i = 0; i < files.size() && usage > textureCacheBudget; i++) {
+        if (files[i].absoluteFilePath() == keep)
+            continue;
+        if (QFile::remove(files[i].absoluteFilePath()))
+            usage -= files[i].size();
+    }
+}
+
+void writeTextureCache(const QString& cacheFile, const QImage& img)
+{
+    QString cacheDir = QFileInfo(cacheFile).path();
+    QDir().mkpath(cacheDir);
+    QSaveFile file(cacheFile);
+    quint32 size[2] = { quint32(img.width()), quint32(img.height()) };
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(reinterpret_cast<const char*>(size), sizeof(size));
+        file.write(reinterpret_cast<const char*>(img.constBits()), qint64(img.bytesPerLine()) * img.height());
+        if (file.commit())
+            trimTextureCache(cacheDir, cacheFile);
+    }
+}
+
+}
 
+QImage loadTextureImage(const QString& fileName, bool mirrorY)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QImage();
+    QByteArray encoded = file.readAll();
+    QString cacheFile = textureCacheFile(encoded, mirrorY);
+    QImage img = readTextureCache(cacheFile);
+    if (!img.isNull())
+        return img;
+
+    if (!img.loadFromData(encoded))
+        return QImage();
     if (mirrorY)
         img = img.mirrored(false, true);
     img = img.convertToFormat(QImage::Format_RGBA8888);
+    writeTextureCache(cacheFile, img);
+    return img;
+}
+
+bool loadIntoTexture(const QString& fileName, GLenum target, bool mirrorY)
+{
+    QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+
+    QImage img = loadTextureImage(fileName, mirrorY);
+    if (img.isNull())
+        return false;
+
     gl->glTexImage2D(target, 0, GL_RGBA8,
             img.width(), img.height(), 0,
             GL_RGBA, GL_UNSIGNED_BYTE, img.constBits());
@@ -155,20 +488,42 @@ bool loadIntoTexture(const QString& fileName, GLenum target, bool mirrorY)
 }
 
 unsigned int loadTexture(const QString& fileName, bool generateMipMap, bool mirrorY)
+{
+    return createTexture(loadTextureImage(fileName, mirrorY), generateMipMap);
+}
+
+QVector<QImage> loadTextureImages(const QStringList& fileNames, bool mirrorY)
+{
+    QVector<QImage> images(fileNames.size());
+    QImage* out = images.data();
+    parallelFor(fileNames.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            out[i] = loadTextureImage(fileNames[i], mirrorY);
+    });
+    return images;
+}
+
+QVector<unsigned int> loadTextures(const QStringList& fileNames, bool generateMipMap, bool mirrorY)
+{
+    QVector<QImage> images = loadTextureImages(fileNames, mirrorY);
+    QVector<unsigned int> textures(images.size());
+    for (int i = 0; i < images.size(); i++)
+        textures[i] = createTexture(images[i], generateMipMap);
+    return textures;
+}
+
+unsigned int createTexture(const QImage& img, bool generateMipMap)
 {
     QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
 
     unsigned int tex = 0;
-    QImage img;
-    if (img.load(fileName)) {
-        if (mirrorY)
-            img = img.mirrored(false, true);
-        img = img.convertToFormat(QImage::Format_RGBA8888);
+    if (!img.isNull()) {
         gl->glGenTextures(1, &tex);
         gl->glBindTexture(GL_TEXTURE_2D, tex);
         gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8,
                 img.width(), img.height(), 0,
                 GL_RGBA, GL_UNSIGNED_BYTE, img.constBits());
+        trackResource(TextureResource, tex, textureBytes(GL_RGBA8, img.width(), img.height(), generateMipMap));
         if (generateMipMap) {
             gl->glGenerateMipmap(GL_TEXTURE_2D);
             gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -211,13 +566,7 @@ unsigned int createVertexArrayObject(
         gl->glBufferData(GL_ARRAY_BUFFER, vertexCount * 3 * sizeof(float), positions.data(), GL_STATIC_DRAW);
     } else {
         data.resize(vertexCount * 3);
-        for (int j = 0; j < vertexCount; j++) {
-            QVector3D v = QVector3D(positions[3 * j + 0], positions[3 * j + 1], positions[3 * j + 2]);
-            QVector3D w = transformationMatrix * v;
-            data[3 * j + 0] = w.x();
-            data[3 * j + 1] = w.y();
-            data[3 * j + 2] = w.z();
-        }
+        transformPoints(transformationMatrix, positions.constData(), 3, data.data(), 3, vertexCount);
         gl->glBufferData(GL_ARRAY_BUFFER, vertexCount * 3 * sizeof(float), data.data(), GL_STATIC_DRAW);
     }
     gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
@@ -231,13 +580,7 @@ unsigned int createVertexArrayObject(
     } else {
         data.resize(vertexCount * 3);
         QMatrix4x4 normalMatrix = QMatrix4x4(transformationMatrix.normalMatrix());
-        for (int j = 0; j < vertexCount; j++) {
-            QVector3D v = QVector3D(normals[3 * j + 0], normals[3 * j + 1], normals[3 * j + 2]);
-            QVector3D w = normalMatrix * v;
-            data[3 * j + 0] = w.x();
-            data[3 * j + 1] = w.y();
-            data[3 * j + 2] = w.z();
-        }
+        transformDirections(normalMatrix, normals.constData(), 3, data.data(), 3, vertexCount);
         gl->glBufferData(GL_ARRAY_BUFFER, vertexCount * 3 * sizeof(float), data.data(), GL_STATIC_DRAW);
     }
     gl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
@@ -259,6 +602,11 @@ unsigned int createVertexArrayObject(
     gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
     gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
+    trackResource(VertexArrayResource, vao);
+    trackResource(BufferResource, positionBuffer, vertexCount * 3 * sizeof(float));
+    trackResource(BufferResource, normalBuffer, vertexCount * 3 * sizeof(float));
+    trackResource(BufferResource, texcoordBuffer, vertexCount * 2 * sizeof(float));
+    trackResource(BufferResource, indexBuffer, indices.count() * sizeof(unsigned int));
     return vao;
 }
 
@@ -294,103 +642,116 @@ void glCheck(const char* callingFunction, const char* file, int line)
 QVector<float> createNormals(const QVector<float>& positions,
         const QVector<unsigned int>& indices, int method)
 {
-    QVector<QVector3D> faceNormals; // normal for each face
-    faceNormals.reserve(indices.size() / 3);
-    QVector<QVector<unsigned int>> vertexFaces;         // list of faces for each vertex
-    vertexFaces.resize(positions.size() / 3);
-
-    for (int i = 0; i < indices.size(); i += 3) {
-        int faceIndex = i / 3;
-        QVector3D v[3];
-        v[0] = QVector3D(positions[3 * indices[i + 0] + 0], positions[3 * indices[i + 0] + 1], positions[3 * indices[i + 0] + 2]);
-        v[1] = QVector3D(positions[3 * indices[i + 1] + 0], positions[3 * indices[i + 1] + 1], positions[3 * indices[i + 1] + 2]);
-        v[2] = QVector3D(positions[3 * indices[i + 2] + 0], positions[3 * indices[i + 2] + 1], positions[3 * indices[i + 2] + 2]);
-        QVector3D e0 = v[1] - v[0];
-        QVector3D e1 = v[2] - v[0];
-        QVector3D e2 = e1 - e0;
-        if (QVector3D::dotProduct(e0, e0) <= 0.0f
-                || QVector3D::dotProduct(e1, e1) <= 0.0f
-                || QVector3D::dotProduct(e2, e2) <= 0.0f) {
-            faceNormals.append(QVector3D(0.0f, 0.0f, 0.0f));
-        } else {
-            faceNormals.append(QVector3D::crossProduct(e0, e1).normalized());
+    int faceCount = indices.size() / 3;
+    int vertexCount = positions.size() / 3;
+    const float* p = positions.constData();
+    const unsigned int* f = indices.constData();
+
+    // Normal for each face, zero for degenerate faces. Plain float arithmetic
+    // on independent faces, so that the compiler can vectorize it.
+    QVector<float> faceNormals(3 * faceCount);
+    float* fn = faceNormals.data();
+    parallelFor(faceCount, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const float* v0 = p + 3 * f[3 * i + 0];
+            const float* v1 = p + 3 * f[3 * i + 1];
+            const float* v2 = p + 3 * f[3 * i + 2];
+            float e0[3] = { v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2] };
+            float e1[3] = { v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2] };
+            float e2[3] = { e1[0] - e0[0], e1[1] - e0[1], e1[2] - e0[2] };
+            float c[3] = {
+                e0[1] * e1[2] - e0[2] * e1[1],
+                e0[2] * e1[0] - e0[0] * e1[2],
+                e0[0] * e1[1] - e0[1] * e1[0] };
+            float l = std::sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]);
+            bool degenerate = (e0[0] * e0[0] + e0[1] * e0[1] + e0[2] * e0[2] <= 0.0f
+                    || e1[0] * e1[0] + e1[1] * e1[1] + e1[2] * e1[2] <= 0.0f
+                    || e2[0] * e2[0] + e2[1] * e2[1] + e2[2] * e2[2] <= 0.0f
+                    || l <= 0.0f);
+            float s = degenerate ? 0.0f : 1.0f / l;
+            fn[3 * i + 0] = c[0] * s;
+            fn[3 * i + 1] = c[1] * s;
+            fn[3 * i + 2] = c[2] * s;
         }
-        vertexFaces[indices[i + 0]].append(faceIndex);
-        vertexFaces[indices[i + 1]].append(faceIndex);
-        vertexFaces[indices[i + 2]].append(faceIndex);
+    }, 4096);
+
+    // Faces of each vertex in a compressed table: the faces of vertex i are
+    // vertexFaces[faceOffsets[i]] to vertexFaces[faceOffsets[i + 1] - 1], in
+    // ascending order. Built with a counting pass and a filling pass.
+    QVector<int> faceOffsets(vertexCount + 1, 0);
+    for (int i = 0; i < indices.size(); i++)
+        faceOffsets[f[i] + 1]++;
+    for (int i = 0; i < vertexCount; i++)
+        faceOffsets[i + 1] += faceOffsets[i];
+    QVector<unsigned int> vertexFaces(indices.size());
+    {
+        QVector<int> next(faceOffsets);
+        for (int i = 0; i < indices.size(); i++)
+            vertexFaces[next[f[i]]++] = i / 3;
     }
 
-    QVector<float> vertexNormals;
-    vertexNormals.reserve(positions.size());
-    for (unsigned int i = 0; i < static_cast<unsigned int>(positions.size() / 3); i++) {
-        QVector3D n = QVector3D(0.0f, 0.0f, 0.0f);
-        if (vertexFaces[i].size() == 0) {
-            // vertex without a face: will not be rendered anyway
-        } else if (vertexFaces[i].size() == 1) {
-            // only one face: no choice in methods
-            n = faceNormals[vertexFaces[i][0]];
-        } else {
-            if (method == 2) {
-                for (int j = 0; j < vertexFaces[i].size(); j++) {
-                    unsigned int faceIndex = vertexFaces[i][j];
-                    unsigned int faceIndices[3] = {
-                        indices[3 * faceIndex + 0],
-                        indices[3 * faceIndex + 1],
-                        indices[3 * faceIndex + 2] };
-                    QVector3D e0, e1;
-                    if (i == faceIndices[0]) {
-                        e0 = QVector3D(positions[3 * faceIndices[1] + 0], positions[3 * faceIndices[1] + 1], positions[3 * faceIndices[1] + 2]);
-                        e1 = QVector3D(positions[3 * faceIndices[2] + 0], positions[3 * faceIndices[2] + 1], positions[3 * faceIndices[2] + 2]);
-                    } else if (i == faceIndices[1]) {
-                        e0 = QVector3D(positions[3 * faceIndices[2] + 0], positions[3 * faceIndices[2] + 1], positions[3 * faceIndices[2] + 2]);
-                        e1 = QVector3D(positions[3 * faceIndices[0] + 0], positions[3 * faceIndices[0] + 1], positions[3 * faceIndices[0] + 2]);
-                    } else {
-                        e0 = QVector3D(positions[3 * faceIndices[0] + 0], positions[3 * faceIndices[0] + 1], positions[3 * faceIndices[0] + 2]);
-                        e1 = QVector3D(positions[3 * faceIndices[1] + 0], positions[3 * faceIndices[1] + 1], positions[3 * faceIndices[1] + 2]);
+    QVector<float> vertexNormals(positions.size());
+    float* vn = vertexNormals.data();
+    auto faceNormal = [&](unsigned int faceIndex) {
+        return QVector3D(fn[3 * faceIndex + 0], fn[3 * faceIndex + 1], fn[3 * faceIndex + 2]);
+    };
+    auto position = [&](unsigned int vertexIndex) {
+        return QVector3D(p[3 * vertexIndex + 0], p[3 * vertexIndex + 1], p[3 * vertexIndex + 2]);
+    };
+    parallelFor(vertexCount, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const unsigned int* faces = vertexFaces.constData() + faceOffsets[i];
+            int count = faceOffsets[i + 1] - faceOffsets[i];
+            QVector3D n = QVector3D(0.0f, 0.0f, 0.0f);
+            if (count == 0) {
+                // vertex without a face: will not be rendered anyway
+            } else if (count == 1) {
+                // only one face: no choice in methods
+                n = faceNormal(faces[0]);
+            } else {
+                if (method == 2) {
+                    for (int j = 0; j < count; j++) {
+                        unsigned int faceIndex = faces[j];
+                        const unsigned int* faceIndices = f + 3 * faceIndex;
+                        QVector3D e0, e1;
+                        if (unsigned(i) == faceIndices[0]) {
+                            e0 = position(faceIndices[1]);
+                            e1 = position(faceIndices[2]);
+                        } else if (unsigned(i) == faceIndices[1]) {
+                            e0 = position(faceIndices[2]);
+                            e1 = position(faceIndices[0]);
+                        } else {
+                            e0 = position(faceIndices[0]);
+                            e1 = position(faceIndices[1]);
+                        }
+                        e0 = e0 - position(i);
+                        e1 = e1 - position(i);
+                        if (QVector3D::dotProduct(e0, e0) <= 0.0f || QVector3D::dotProduct(e1, e1) <= 0.0f)
+                            continue;
+                        float x = QVector3D::dotProduct(e0.normalized(), e1.normalized());
+                        if (x < -1.0f)
+                            x = -1.0f;
+                        else if (x > 1.0f)
+                            x = 1.0f;
+                        float alpha = std::acos(x);
+                        n += alpha * faceNormal(faceIndex);
                     }
-                    e0 = e0 - QVector3D(positions[3 * i + 0], positions[3 * i + 1], positions[3 * i + 3]);
-                    e1 = e1 - QVector3D(positions[3 * i + 0], positions[3 * i + 1], positions[3 * i + 3]);
-                    if (QVector3D::dotProduct(e0, e0) <= 0.0f || QVector3D::dotProduct(e1, e1) <= 0.0f)
-                        continue;
-                    float x = QVector3D::dotProduct(e0.normalized(), e1.normalized());
-                    if (x < -1.0f)
-                        x = -1.0f;
-                    else if (x > 1.0f)
-                        x = 1.0f;
-                    float alpha = std::acos(x);
-                    n += alpha * faceNormals[faceIndex];
                 }
-            }
-            if (method == 1 || (method == 2 && QVector3D::dotProduct(n, n) <= 0.0f)) { // use equal weights for each face
-                n = QVector3D(0.0f, 0.0f, 0.0f);
-                for (int j = 0; j < vertexFaces[i].size(); j++) {
-                    int faceIndex = vertexFaces[i][j];
-                    n += faceNormals[faceIndex];
+                if (method == 1 || (method == 2 && QVector3D::dotProduct(n, n) <= 0.0f)) { // use equal weights for each face
+                    n = QVector3D(0.0f, 0.0f, 0.0f);
+                    for (int j = 0; j < count; j++)
+                        n += faceNormal(faces[j]);
                 }
-            }
-            if (method == 0 || QVector3D::dotProduct(n, n) <= 0.0f) { // use first face normal
-                int faceIndex = vertexFaces[i][0];
-                n = faceNormals[faceIndex];
-            }
-            n.normalize();
-#if 0
-            // Sanity check: the angle between our computed normal and each face
-            // normal must always be smaller than 90 degrees. If that is not the
-            // case, simply fall back to the first face normal.
-            for (size_t j = 0; j < vertexFaces[i].size(); j++) {
-                size_t faceIndex = vertexFaces[i][j];
-                vec3 fn = faceNormals[faceIndex];
-                if (dot(n, fn) >= half_pi<float>()) {
-                    n = faceNormals[vertexFaces[i][0]];
-                    break;
+                if (method == 0 || QVector3D::dotProduct(n, n) <= 0.0f) { // use first face normal
+                    n = faceNormal(faces[0]);
                 }
+                n.normalize();
             }
-#endif
+            vn[3 * i + 0] = n.x();
+            vn[3 * i + 1] = n.y();
+            vn[3 * i + 2] = n.z();
         }
-        vertexNormals.append(n.x());
-        vertexNormals.append(n.y());
-        vertexNormals.append(n.z());
-    }
+    }, 1024);
 
     return vertexNormals;
 }
@@ -398,54 +759,131 @@ QVector<float> createNormals(const QVector<float>& positions,
 QVector<unsigned int> createAdjacency(const QVector<unsigned int>& indices)
 {
     Q_ASSERT(indices.size() % 3 == 0);
-    QVector<unsigned int> indicesWithAdjacency(indices.size() / 3 * 6);
-    for (int t = 0; t < indices.size() / 3; t++) {
-        unsigned int v[3] = { indices[3 * t + 0], indices[3 * t + 1], indices[3 * t + 2] };
-        unsigned int nv[3] = { v[2], v[0], v[1] }; // neighbor triangle vertices for edges 0, 1, 2
-        for (int nt = 0; nt < indices.size() / 3; nt++) {
-            if (nt == t)
-                continue;
-            unsigned int test_nv[3] = { indices[3 * nt + 0], indices[3 * nt + 1], indices[3 * nt + 2] };
-            // Test edges. Neighbor triangles must have the same orientation as the
-            // current triangle, so we only have to check one edge direction.
-            // edge 0
-            if (nv[0] == v[2]) {
-                if (v[0] == test_nv[1] && v[1] == test_nv[0])
-                    nv[0] = test_nv[2];
-                else if (v[0] == test_nv[2] && v[1] == test_nv[1])
-                    nv[0] = test_nv[0];
-                else if (v[0] == test_nv[0] && v[1] == test_nv[2])
-                    nv[0] = test_nv[1];
-            }
-            // edge 1
-            if (nv[1] == v[0]) {
-                if (v[1] == test_nv[1] && v[2] == test_nv[0])
-                    nv[1] = test_nv[2];
-                else if (v[1] == test_nv[2] && v[2] == test_nv[1])
-                    nv[1] = test_nv[0];
-                else if (v[1] == test_nv[0] && v[2] == test_nv[2])
-                    nv[1] = test_nv[1];
+    int triangleCount = indices.size() / 3;
+
+    // All directed edges with their position 3 * triangle + k, where edge k
+    // goes from vertex k to vertex (k + 1) % 3. Equal edges are sorted by
+    // position, so that they are found in the same order as by a linear
+    // search through the triangles.
+    struct Edge {
+        quint64 key;
+        unsigned int position;
+        bool operator<(const Edge& e) const { return key < e.key || (key == e.key && position < e.position); }
+    };
+    auto edgeKey = [](unsigned int from, unsigned int to) { return (quint64(from) << 32) | to; };
+    QVector<Edge> edges(indices.size());
+    parallelFor(triangleCount, [&](int begin, int end) {
+        for (int t = begin; t < end; t++) {
+            for (int k = 0; k < 3; k++) {
+                edges[3 * t + k].key = edgeKey(indices[3 * t + k], indices[3 * t + (k + 1) % 3]);
+                edges[3 * t + k].position = 3 * t + k;
             }
-            // edge 2
-            if (nv[2] == v[1]) {
-                if (v[2] == test_nv[1] && v[0] == test_nv[0])
-                    nv[2] = test_nv[2];
-                else if (v[2] == test_nv[2] && v[0] == test_nv[1])
-                    nv[2] = test_nv[0];
-                else if (v[2] == test_nv[0] && v[0] == test_nv[2])
-                    nv[2] = test_nv[1];
+        }
+    }, 4096);
+    std::sort(edges.begin(), edges.end());
+
+    QVector<unsigned int> indicesWithAdjacency(triangleCount * 6);
+    parallelFor(triangleCount, [&](int begin, int end) {
+        for (int t = begin; t < end; t++) {
+            unsigned int v[3] = { indices[3 * t + 0], indices[3 * t + 1], indices[3 * t + 2] };
+            unsigned int nv[3] = { v[2], v[0], v[1] }; // neighbor triangle vertices for edges 0, 1, 2
+            for (int e = 0; e < 3; e++) {
+                // Neighbor triangles must have the same orientation as the
+                // current triangle, so they contain the edge in the opposite
+                // direction. Only the first such edge of a triangle counts,
+                // and a neighbor vertex that is the default does not.
+                quint64 key = edgeKey(v[(e + 1) % 3], v[e]);
+                auto it = std::lower_bound(edges.cbegin(), edges.cend(), Edge { key, 0 });
+                int previous = -1;
+                for (; it != edges.cend() && it->key == key; ++it) {
+                    int nt = it->position / 3;
+                    if (nt == t || nt == previous)
+                        continue;
+                    previous = nt;
+                    unsigned int opposite = indices[3 * nt + (it->position % 3 + 2) % 3];
+                    if (opposite != nv[e]) {
+                        nv[e] = opposite;
+                        break;
+                    }
+                }
             }
-            if (nv[0] != v[2] && nv[1] != v[0] && nv[2] != v[1])
+            indicesWithAdjacency[6 * t + 0] = v[0];
+            indicesWithAdjacency[6 * t + 1] = nv[0];
+            indicesWithAdjacency[6 * t + 2] = v[1];
+            indicesWithAdjacency[6 * t + 3] = nv[1];
+            indicesWithAdjacency[6 * t + 4] = v[2];
+            indicesWithAdjacency[6 * t + 5] = nv[2];
+        }
+    }, 4096);
+    return indicesWithAdjacency;
+}
+
+namespace {
+
+class ParallelForTask : public QRunnable
+{
+private:
+    const std::function<void (int, int)>& _body;
+    QAtomicInt& _nextChunk;
+    QSemaphore& _done;
+    int _n;
+    int _chunkSize;
+
+public:
+    ParallelForTask(const std::function<void (int, int)>& body, QAtomicInt& nextChunk,
+            QSemaphore& done, int n, int chunkSize) :
+        _body(body), _nextChunk(nextChunk), _done(done), _n(n), _chunkSize(chunkSize)
+    {
+    }
+
+    void work()
+    {
+        for (;;) {
+            int begin = _nextChunk.fetchAndAddRelaxed(1) * _chunkSize;
+            if (begin >= _n)
                 break;
+            _body(begin, std::min(begin + _chunkSize, _n));
         }
-        indicesWithAdjacency[6 * t + 0] = v[0];
-        indicesWithAdjacency[6 * t + 1] = nv[0];
-        indicesWithAdjacency[6 * t + 2] = v[1];
-        indicesWithAdjacency[6 * t + 3] = nv[1];
-        indicesWithAdjacency[6 * t + 4] = v[2];
-        indicesWithAdjacency[6 * t + 5] = nv[2];
     }
-    return indicesWithAdjacency;
+
+    void run() override
+    {
+        work();
+        _done.release();
+    }
+};
+
+}
+
+void parallelFor(int n, const std::function<void (int, int)>& body, int grainSize)
+{
+    if (n <= 0)
+        return;
+    QThreadPool* pool = QThreadPool::globalInstance();
+    int threads = std::max(pool->maxThreadCount(), 1);
+    // Use a few chunks per thread so that uneven chunks balance out
+    int chunkSize = std::max(std::max(grainSize, 1), n / (4 * threads));
+    int chunks = (n + chunkSize - 1) / chunkSize;
+    if (threads == 1 || chunks == 1) {
+        body(0, n);
+        return;
+    }
+
+    QAtomicInt nextChunk(0);
+    QSemaphore done;
+    int helpers = 0;
+    for (int i = 0; i < std::min(threads, chunks) - 1; i++) {
+        // Only use threads that are idle right now; this keeps nested calls
+        // from deadlocking, since the calling thread does the rest.
+        ParallelForTask* task = new ParallelForTask(body, nextChunk, done, n, chunkSize);
+        if (!pool->tryStart(task)) {
+            delete task;
+            break;
+        }
+        helpers++;
+    }
+    ParallelForTask(body, nextChunk, done, n, chunkSize).work();
+    done.acquire(helpers);
 }
 
 }
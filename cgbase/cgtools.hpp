@@ -4,9 +4,15 @@
 #ifndef CGTOOLS_HPP
 #define CGTOOLS_HPP
 
+#include <functional>
+
 #include <QVector>
 #include <QMatrix4x4>
 #include <QString>
+#include <QStringList>
+#include <QImage>
+#include <QByteArray>
+#include <QIODevice>
 
 #include "cgopenglwidget.hpp"
 
@@ -19,23 +25,63 @@ void init(int& argc, char* argv[], OpenGLWidget* widget);
 
 /* Load geometry from an OBJ file. Only positions, normals, and texture
  * coordinates are imported. Materials are ignored.
- * The data is suitable for rendering in GL_TRIANGLES mode. */
+ * The data is suitable for rendering in GL_TRIANGLES mode. Corners with the
+ * same position, normal, and texture coordinate share one vertex.
+ * Files can be Qt resources. */
 bool loadObj(const QString& fileName,
         QVector<float>& positions,
         QVector<float>& normals,
         QVector<float>& texCoords,
         QVector<unsigned int>& indices);
 
+/* Same as above, but read the OBJ data from a device. It is opened for
+ * reading if it is not open yet. */
+bool loadObj(QIODevice* device,
+        QVector<float>& positions,
+        QVector<float>& normals,
+        QVector<float>& texCoords,
+        QVector<unsigned int>& indices);
+
+/* Same as above, but parse OBJ data in memory. Large data is parsed in
+ * parallel chunks. */
+bool loadObj(const QByteArray& data,
+        QVector<float>& positions,
+        QVector<float>& normals,
+        QVector<float>& texCoords,
+        QVector<unsigned int>& indices);
+
 /* Load a texture from an image file. Optionally a mipmap is generated automatically;
- * the texture filtering parameters will be set accordingly. */
+ * the texture filtering parameters will be set accordingly. The texture is
+ * registered with the resource tracker (see cgresources.hpp). */
 unsigned int loadTexture(const QString& fileName, bool generateMipMap = true, bool mirrorY = true);
 
+/* Same as above for several files at once. The images are decoded in
+ * parallel; only the uploads happen on the calling thread. Textures of files
+ * that cannot be loaded are 0. */
+QVector<unsigned int> loadTextures(const QStringList& fileNames, bool generateMipMap = true, bool mirrorY = true);
+
+/* Decode an image file into the RGBA8888 format in which loadTexture()
+ * uploads it. Decoded images are kept in a cache on disk, keyed by the
+ * contents of the file, so that later calls skip decompression. The cache
+ * is limited to 512 MiB; beyond that, the oldest entries are removed.
+ * Does not need an OpenGL context and can be called from any thread. */
+QImage loadTextureImage(const QString& fileName, bool mirrorY = true);
+
+/* Same as above for several files at once, decoded in parallel */
+QVector<QImage> loadTextureImages(const QStringList& fileNames, bool mirrorY = true);
+
+/* Create a texture from an image as returned by loadTextureImage(), with
+ * the same parameters as loadTexture(). Returns 0 for a null image. */
+unsigned int createTexture(const QImage& img, bool generateMipMap = true);
+
 /* Load an image file into an existing texture, e.g. into cube map components. */
 bool loadIntoTexture(const QString& fileName, GLenum target = GL_TEXTURE_2D, bool mirrorY = true);
 
 /* Create a vertex array object from geometry data that is suitable for rendering
  * in GL_TRIANGLES mode. This function can pre-transform the geometry with a
- * transformation matrix. */
+ * transformation matrix. The buffers of the vertex array object cannot be
+ * deleted; use Cg::VertexArray (see cgvertexarray.hpp) for geometry that
+ * changes or does not live as long as the program. */
 unsigned int createVertexArrayObject(
         const QVector<float>& positions,
         const QVector<float>& normals,
@@ -83,10 +129,17 @@ QVector<float> createNormals(const QVector<float>& positions,
  * that provides GL_TRIANGLES_ADJACENCY. This is useful for geometry shaders.
  * If a neighboring triangle is not found for an edge of a given triangle, the
  * neighbor for that edge will be set to the triangle itself, only in opposite direction.
- * WARNING: the current naive implementation is O(n²). Only use once on initialization,
- * and do not use with larger models. */
+ * The edges are sorted once and then looked up in parallel, so this takes
+ * O(n log n) time. */
 QVector<unsigned int> createAdjacency(const QVector<unsigned int>& indices);
 
+/* Partition the range [0, n) into consecutive chunks of at least grainSize
+ * elements and call body(begin, end) for each chunk, using the threads of the
+ * global QThreadPool. The calling thread takes part in the work, and the
+ * function returns when all chunks are done. Chunks are handed out
+ * dynamically, so the body does not need to have uniform cost. */
+void parallelFor(int n, const std::function<void (int, int)>& body, int grainSize = 1);
+
 }
 
 #endif
@@ -0,0 +1,222 @@
+/* Copyright (C) 2018 Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de> */
+
+#include <algorithm>
+#include <cstring>
+
+#include <QOpenGLContext>
+
+#include "cgresources.hpp"
+#include "cgtools.hpp"
+#include "cgvertexarray.hpp"
+
+namespace Cg
+{
+
+/* Transform in batches with plain loops over the matrix elements, so that
+ * the compiler can vectorize them; w is 1 for points and 0 for directions.
+ * The result is not divided by w, as in QMatrix4x4::mapVector() and
+ * for affine matrices in QMatrix4x4::map(). */
+static void transform(const QMatrix4x4& matrix, float w, const float* in, int inStride,
+        float* out, int outStride, int count)
+{
+    const float* m = matrix.constData(); // column-major
+    float c[12] = {
+        m[0], m[1], m[2], m[4], m[5], m[6],
+        m[8], m[9], m[10], w * m[12], w * m[13], w * m[14] };
+    parallelFor(count, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            float x = in[i * inStride + 0];
+            float y = in[i * inStride + 1];
+            float z = in[i * inStride + 2];
+            out[i * outStride + 0] = c[0] * x + c[3] * y + c[6] * z + c[9];
+            out[i * outStride + 1] = c[1] * x + c[4] * y + c[7] * z + c[10];
+            out[i * outStride + 2] = c[2] * x + c[5] * y + c[8] * z + c[11];
+        }
+    }, 16384);
+}
+
+void transformPoints(const QMatrix4x4& matrix, const float* in, int inStride,
+        float* out, int outStride, int count)
+{
+    transform(matrix, 1.0f, in, inStride, out, outStride, count);
+}
+
+void transformDirections(const QMatrix4x4& matrix, const float* in, int inStride,
+        float* out, int outStride, int count)
+{
+    transform(matrix, 0.0f, in, inStride, out, outStride, count);
+}
+
+VertexArray::VertexArray() :
+    _vao(0),
+    _buffers { 0, 0 },
+    _vertexCount(0),
+    _indexCount(0)
+{
+}
+
+VertexArray::~VertexArray()
+{
+    // Without a context the objects are gone already or will go with the context
+    if (QOpenGLContext::currentContext())
+        destroy();
+}
+
+VertexArray::VertexArray(VertexArray&& other) :
+    _vao(other._vao),
+    _buffers { other._buffers[0], other._buffers[1] },
+    _vertexCount(other._vertexCount),
+    _indexCount(other._indexCount)
+{
+    other._vao = 0;
+    other._buffers[0] = other._buffers[1] = 0;
+    other._vertexCount = other._indexCount = 0;
+}
+
+VertexArray& VertexArray::operator=(VertexArray&& other)
+{
+    if (this != &other) {
+        destroy();
+        std::swap(_vao, other._vao);
+        std::swap(_buffers[0], other._buffers[0]);
+        std::swap(_buffers[1], other._buffers[1]);
+        std::swap(_vertexCount, other._vertexCount);
+        std::swap(_indexCount, other._indexCount);
+    }
+    return *this;
+}
+
+void VertexArray::destroy()
+{
+    if (_vao == 0)
+        return;
+    QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+    gl->glDeleteVertexArrays(1, &_vao);
+    gl->glDeleteBuffers(2, _buffers);
+    untrackResource(VertexArrayResource, _vao);
+    untrackResource(BufferResource, _buffers[0]);
+    untrackResource(BufferResource, _buffers[1]);
+    _vao = 0;
+    _buffers[0] = _buffers[1] = 0;
+    _vertexCount = 0;
+    _indexCount = 0;
+}
+
+void VertexArray::create(const QVector<float>& positions,
+        const QVector<float>& normals,
+        const QVector<float>& texCoords,
+        const QVector<unsigned int>& indices,
+        const QMatrix4x4& transformationMatrix,
+        GLenum usage)
+{
+    Q_ASSERT(positions.size() % 3 == 0);
+    Q_ASSERT(positions.size() > 0);
+    Q_ASSERT(positions.size() == normals.size());
+    Q_ASSERT(positions.size() / 3 == texCoords.size() / 2);
+    Q_ASSERT(indices.size() > 0);
+    Q_ASSERT(indices.size() % 3 == 0);
+
+    QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+    int vertexCount = positions.size() / 3;
+
+    if (_vao == 0) {
+        gl->glGenVertexArrays(1, &_vao);
+        gl->glGenBuffers(2, _buffers);
+        gl->glBindVertexArray(_vao);
+        gl->glBindBuffer(GL_ARRAY_BUFFER, _buffers[0]);
+        const GLsizei stride = floatsPerVertex * sizeof(float);
+        gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(0));
+        gl->glEnableVertexAttribArray(0);
+        gl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(3 * sizeof(float)));
+        gl->glEnableVertexAttribArray(1);
+        gl->glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(6 * sizeof(float)));
+        gl->glEnableVertexAttribArray(2);
+        gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _buffers[1]);
+    }
+    gl->glBindVertexArray(_vao);
+
+    // Allocate the buffers and fill them through update()
+    gl->glBindBuffer(GL_ARRAY_BUFFER, _buffers[0]);
+    gl->glBufferData(GL_ARRAY_BUFFER, vertexCount * floatsPerVertex * sizeof(float), nullptr, usage);
+    gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.constData(), usage);
+    _vertexCount = vertexCount;
+    _indexCount = indices.size();
+    trackResource(VertexArrayResource, _vao);
+    trackResource(BufferResource, _buffers[0], vertexCount * floatsPerVertex * sizeof(float));
+    trackResource(BufferResource, _buffers[1], indices.size() * sizeof(unsigned int));
+    if (transformationMatrix.isIdentity()) {
+        update(0, positions, normals, texCoords);
+    } else {
+        QVector<float> p(positions.size());
+        QVector<float> n(normals.size());
+        transformPoints(transformationMatrix, positions.constData(), 3, p.data(), 3, vertexCount);
+        transformDirections(QMatrix4x4(transformationMatrix.normalMatrix()),
+                normals.constData(), 3, n.data(), 3, vertexCount);
+        update(0, p, n, texCoords);
+    }
+
+    gl->glBindVertexArray(0);
+    gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void VertexArray::update(int firstVertex,
+        const QVector<float>& positions,
+        const QVector<float>& normals,
+        const QVector<float>& texCoords)
+{
+    int count = std::max(positions.size() / 3, std::max(normals.size() / 3, texCoords.size() / 2));
+    Q_ASSERT(positions.isEmpty() || positions.size() == 3 * count);
+    Q_ASSERT(normals.isEmpty() || normals.size() == 3 * count);
+    Q_ASSERT(texCoords.isEmpty() || texCoords.size() == 2 * count);
+    Q_ASSERT(firstVertex >= 0 && firstVertex + count <= _vertexCount);
+    if (count == 0)
+        return;
+
+    // Write the given attributes into the mapped range; the others keep
+    // their contents, so the range is not invalidated
+    QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+    gl->glBindBuffer(GL_ARRAY_BUFFER, _buffers[0]);
+    bool complete = !positions.isEmpty() && !normals.isEmpty() && !texCoords.isEmpty();
+    float* data = static_cast<float*>(gl->glMapBufferRange(GL_ARRAY_BUFFER,
+                firstVertex * floatsPerVertex * sizeof(float), count * floatsPerVertex * sizeof(float),
+                GL_MAP_WRITE_BIT | (complete ? GL_MAP_INVALIDATE_RANGE_BIT : 0)));
+    if (!data) {
+        qCritical("Cannot map vertex buffer");
+        gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return;
+    }
+    parallelFor(count, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            float* v = data + i * floatsPerVertex;
+            if (!positions.isEmpty())
+                std::memcpy(v + 0, positions.constData() + 3 * i, 3 * sizeof(float));
+            if (!normals.isEmpty())
+                std::memcpy(v + 3, normals.constData() + 3 * i, 3 * sizeof(float));
+            if (!texCoords.isEmpty())
+                std::memcpy(v + 6, texCoords.constData() + 2 * i, 2 * sizeof(float));
+        }
+    }, 16384);
+    gl->glUnmapBuffer(GL_ARRAY_BUFFER);
+    gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void VertexArray::updateIndices(int firstIndex, const QVector<unsigned int>& indices)
+{
+    Q_ASSERT(firstIndex >= 0 && firstIndex + indices.size() <= _indexCount);
+    QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+    // the element array buffer binding is part of the vertex array state
+    gl->glBindVertexArray(_vao);
+    gl->glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, firstIndex * sizeof(unsigned int),
+            indices.size() * sizeof(unsigned int), indices.constData());
+    gl->glBindVertexArray(0);
+}
+
+void VertexArray::draw(GLenum mode) const
+{
+    QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+    gl->glBindVertexArray(_vao);
+    gl->glDrawElements(mode, _indexCount, GL_UNSIGNED_INT, 0);
+}
+
+}
@@ -0,0 +1,85 @@
+/* Copyright (C) 2018 Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de> */
+
+#ifndef CGVERTEXARRAY_HPP
+#define CGVERTEXARRAY_HPP
+
+#include <QVector>
+#include <QMatrix4x4>
+#include <QOpenGLExtraFunctions>
+
+namespace Cg
+{
+
+/* Transform count points (w = 1) or directions (w = 0) with three floats
+ * each by the given matrix. The input and output may be the same, and the
+ * stride between consecutive elements is given in floats. Large inputs are
+ * split into batches that are transformed in parallel. */
+void transformPoints(const QMatrix4x4& matrix, const float* in, int inStride,
+        float* out, int outStride, int count);
+void transformDirections(const QMatrix4x4& matrix, const float* in, int inStride,
+        float* out, int outStride, int count);
+
+/* A vertex array object together with the buffers it uses: one interleaved
+ * buffer with the position (attribute location 0), normal (1) and texture
+ * coordinates (2) of each vertex, and one index buffer. The object owns the
+ * buffers and deletes everything when it is destroyed, so it cannot be
+ * copied, only moved.
+ * All functions except the constructor need a current OpenGL context; the
+ * destructor skips the deletion if there is none. */
+class VertexArray
+{
+private:
+    unsigned int _vao;
+    unsigned int _buffers[2]; // vertices, indices
+    int _vertexCount;
+    int _indexCount;
+
+public:
+    static constexpr int floatsPerVertex = 8; // position, normal, texture coordinates
+
+    /* Create an empty vertex array; nothing is allocated before create() */
+    VertexArray();
+    ~VertexArray();
+    VertexArray(const VertexArray&) = delete;
+    VertexArray& operator=(const VertexArray&) = delete;
+    VertexArray(VertexArray&& other);
+    VertexArray& operator=(VertexArray&& other);
+
+    /* Upload geometry data that is suitable for rendering in GL_TRIANGLES
+     * mode, replacing any previous contents. The geometry can be
+     * pre-transformed with a transformation matrix. The usage hint is
+     * passed to glBufferData(). */
+    void create(const QVector<float>& positions,
+            const QVector<float>& normals,
+            const QVector<float>& texCoords,
+            const QVector<unsigned int>& indices,
+            const QMatrix4x4& transformationMatrix = QMatrix4x4(),
+            GLenum usage = GL_STATIC_DRAW);
+
+    /* Overwrite the attributes of the vertices starting at firstVertex in
+     * place. Empty vectors leave their attribute unchanged; the others must
+     * have the same number of vertices, which must fit into the array. */
+    void update(int firstVertex,
+            const QVector<float>& positions,
+            const QVector<float>& normals = QVector<float>(),
+            const QVector<float>& texCoords = QVector<float>());
+
+    /* Overwrite the indices starting at firstIndex in place */
+    void updateIndices(int firstIndex, const QVector<unsigned int>& indices);
+
+    /* Delete the vertex array and its buffers */
+    void destroy();
+
+    bool isValid() const { return _vao != 0; }
+    unsigned int vao() const { return _vao; }
+    int vertexCount() const { return _vertexCount; }
+    int indexCount() const { return _indexCount; }
+
+    /* Bind the vertex array and draw all indices */
+    void draw(GLenum mode = GL_TRIANGLES) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,193 @@
+#include <cstring>
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QThread>
+#include <QVector>
+
+#include "cgbase/cgtools.hpp"
+
+#include "flowbake.hpp"
+
+
+/* Writes a cache file, and keeps whether that worked for finishBake() */
+class MeshBake::BakeThread : public QThread
+{
+public:
+	QString fileName;
+	Header header;
+	std::function<void (int, quint16*)> compute;
+	QAtomicInt abort;
+	bool ok;
+
+protected:
+	void run() override
+	{
+		ok = MeshBake::write(fileName, header, compute, abort);
+	}
+};
+
+MeshBake::MeshBake() :
+	_map(nullptr),
+	_offsets(nullptr),
+	_thread(nullptr)
+{
+	std::memset(&_header, 0, sizeof(_header));
+}
+
+MeshBake::~MeshBake()
+{
+	// abandon the bake: the thread calls back into the owner, which must outlive it
+	if (_thread) {
+		_thread->abort.storeRelease(1);
+		_thread->wait();
+		delete _thread;
+	}
+	close();
+}
+
+MeshBake::Header MeshBake::makeHeader(const QString& dataFileName,
+		int xCells, int yCells, int tCells, int nMesh, float stepSize, int vertexCount)
+{
+	Header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "FLOWBAKE", 8);
+	header.version = _version;
+	header.xCells = xCells;
+	header.yCells = yCells;
+	header.tCells = tCells;
+	header.nMesh = nMesh;
+	header.stepSize = stepSize;
+	header.vertexCount = vertexCount;
+	QFileInfo dataFile(dataFileName);
+	header.dataSize = dataFile.size();
+	header.dataModified = dataFile.lastModified().toMSecsSinceEpoch();
+	return header;
+}
+
+QString MeshBake::fileName(int nMesh, float stepSize)
+{
+	// the step size is compared exactly, so name it by its bit pattern
+	quint32 stepBits;
+	std::memcpy(&stepBits, &stepSize, sizeof(stepBits));
+	return QString("flow-bake-%1-%2.bin").arg(nMesh).arg(stepBits, 8, 16, QChar('0'));
+}
+
+void MeshBake::close()
+{
+	if (_map)
+		_file.unmap(_map);
+	_file.close();
+	_map = nullptr;
+	_offsets = nullptr;
+}
+
+bool MeshBake::open(const QString& fileName, const QString& dataFileName,
+		int xCells, int yCells, int tCells, int nMesh, float stepSize)
+{
+	close();
+	_file.setFileName(fileName);
+	if (!_file.open(QIODevice::ReadOnly))
+		return false;
+	Header header;
+	Header expected = makeHeader(dataFileName, xCells, yCells, tCells, nMesh, stepSize, 0);
+	qint64 tableEnd = sizeof(Header) + tCells * sizeof(quint64);
+	if (_file.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header)
+			|| std::memcmp(header.magic, "FLOWBAKE", 8) != 0 || header.version != _version
+			|| header.xCells != xCells || header.yCells != yCells || header.tCells != tCells
+			|| header.nMesh != nMesh || header.stepSize != stepSize
+			|| header.dataSize != expected.dataSize || header.dataModified != expected.dataModified
+			|| _file.size() != tableEnd + qint64(tCells) * header.vertexCount * qint64(2 * sizeof(quint16))) {
+		_file.close();
+		return false;
+	}
+	_map = _file.map(0, _file.size());
+	if (!_map) {
+		_file.close();
+		return false;
+	}
+	_header = header;
+	_offsets = reinterpret_cast<const quint64*>(_map + sizeof(Header));
+	return true;
+}
+
+/* Writes the cache file under a temporary name and renames it when it is
+ * complete, so that open() never maps a partial file. Gives up between
+ * slices once abort is set. */
+bool MeshBake::write(const QString& fileName, const Header& header,
+		const std::function<void (int, quint16*)>& compute, const QAtomicInt& abort)
+{
+	int tCells = header.tCells;
+	qint64 sliceSize = qint64(header.vertexCount) * 2 * sizeof(quint16);
+	qint64 tableEnd = sizeof(Header) + tCells * sizeof(quint64);
+	QVector<quint64> offsets(tCells);
+	for (int t = 0; t < tCells; t++)
+		offsets[t] = tableEnd + t * sliceSize;
+
+	// Write header and table, and let the workers fill the slices in place
+	QString partFileName = fileName + ".part";
+	QFile file(partFileName);
+	if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate)
+			|| file.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header)
+			|| file.write(reinterpret_cast<const char*>(offsets.constData()), tCells * sizeof(quint64))
+				!= qint64(tCells * sizeof(quint64))
+			|| !file.resize(tableEnd + tCells * sliceSize)) {
+		file.close();
+		QFile::remove(partFileName);
+		return false;
+	}
+	uchar* map = file.map(0, file.size());
+	if (!map) {
+		file.close();
+		QFile::remove(partFileName);
+		return false;
+	}
+	Cg::parallelFor(tCells, [&](int begin, int end) {
+		for (int t = begin; t < end && !abort.loadAcquire(); t++)
+			compute(t, reinterpret_cast<quint16*>(map + offsets[t]));
+	});
+	file.unmap(map);
+	file.close();
+	if (abort.loadAcquire()) {
+		QFile::remove(partFileName);
+		return false;
+	}
+
+	QFile::remove(fileName);
+	if (!QFile::rename(partFileName, fileName)) {
+		QFile::remove(partFileName);
+		return false;
+	}
+	return true;
+}
+
+void MeshBake::bake(const QString& fileName, const QString& dataFileName,
+		int xCells, int yCells, int tCells, int nMesh, float stepSize,
+		int vertexCount, const std::function<void (int, quint16*)>& compute)
+{
+	if (_thread)
+		return;
+	close();
+	_thread = new BakeThread;
+	_thread->fileName = fileName;
+	_thread->header = makeHeader(dataFileName, xCells, yCells, tCells, nMesh, stepSize, vertexCount);
+	_thread->compute = compute;
+	_thread->ok = false;
+	_thread->start(QThread::LowPriority);
+}
+
+bool MeshBake::isBaking() const
+{
+	return _thread && !_thread->isFinished();
+}
+
+bool MeshBake::finishBake(bool* ok)
+{
+	if (!_thread || !_thread->isFinished())
+		return false;
+	_thread->wait();
+	*ok = _thread->ok;
+	delete _thread;
+	_thread = nullptr;
+	return true;
+}
@@ -0,0 +1,99 @@
+#ifndef FLOWBAKE_HPP
+#define FLOWBAKE_HPP
+
+#include <functional>
+
+#include <QAtomicInt>
+#include <QFile>
+#include <QString>
+
+/* A cache file with the vertex positions of the uniform advection mesh for
+ * every time slice of a data set, for one mesh resolution and step size.
+ * The file consists of a header with these parameters and the size and
+ * modification time of the data file, a table with the offset of each
+ * slice, and the positions of each slice as two 16-bit normalized integers
+ * per vertex, in the order in which the mesh is built. It is memory-mapped,
+ * so that a slice can be handed to OpenGL without copying or parsing.
+ * Baking takes a while, so it runs in a background thread. */
+class MeshBake
+{
+private:
+	struct Header {
+		char magic[8];
+		quint32 version;
+		qint32 xCells;
+		qint32 yCells;
+		qint32 tCells;
+		qint32 nMesh;
+		float stepSize;
+		qint32 vertexCount;
+		quint32 padding;     // keeps the offset table behind the header aligned
+		qint64 dataSize;     // of the data file, to notice when it changes
+		qint64 dataModified; // in milliseconds since the epoch
+	};
+	static_assert(sizeof(Header) % sizeof(quint64) == 0, "the offset table must be aligned");
+	static constexpr quint32 _version = 3;
+
+	class BakeThread;
+
+	QFile _file;
+	uchar* _map;
+	Header _header;
+	const quint64* _offsets;
+	BakeThread* _thread;
+
+	static Header makeHeader(const QString& dataFileName,
+			int xCells, int yCells, int tCells, int nMesh, float stepSize, int vertexCount);
+	static bool write(const QString& fileName, const Header& header,
+			const std::function<void (int, quint16*)>& compute, const QAtomicInt& abort);
+
+public:
+	MeshBake();
+	~MeshBake();
+
+	/* The file name for a cache with the given parameters */
+	static QString fileName(int nMesh, float stepSize);
+
+	/* Map an existing cache file. Returns false if it is missing, broken,
+	 * was baked with other parameters, or from another version of the data
+	 * file. */
+	bool open(const QString& fileName, const QString& dataFileName,
+			int xCells, int yCells, int tCells, int nMesh, float stepSize);
+
+	/* Start creating a cache file in a background thread, unless one is
+	 * created already. The positions of each slice t are computed by
+	 * compute(t, positions), which is called in parallel for different
+	 * slices and must fill 2 * vertexCount integers; it must not depend on
+	 * state that changes meanwhile. The file only appears under its name
+	 * when it is complete; destroying the MeshBake abandons the bake. */
+	void bake(const QString& fileName, const QString& dataFileName,
+			int xCells, int yCells, int tCells, int nMesh, float stepSize,
+			int vertexCount, const std::function<void (int, quint16*)>& compute);
+
+	/* Check if a background bake is running */
+	bool isBaking() const;
+
+	/* If a background bake has ended, returns true and stores whether the
+	 * file was written in ok. Afterwards, the file can be opened. */
+	bool finishBake(bool* ok);
+
+	void close();
+
+	bool isOpen() const { return _map != nullptr; }
+
+	/* Check if the open cache matches the given mesh parameters */
+	bool matches(int nMesh, float stepSize) const
+	{
+		return isOpen() && _header.nMesh == nMesh && _header.stepSize == stepSize;
+	}
+
+	int vertexCount() const { return _header.vertexCount; }
+
+	/* The positions of slice t, two integers per vertex */
+	const quint16* positions(int t) const
+	{
+		return reinterpret_cast<const quint16*>(_map + _offsets[t]);
+	}
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "cgbase/cgtools.hpp"
+
+#include "flowbounds.hpp"
+
+
+FlowBounds::FlowBounds(int tileSize) :
+	_tileSize(tileSize),
+	_xTiles(0),
+	_yTiles(0),
+	_tCells(0)
+{
+}
+
+void FlowBounds::compute(const FlowField& field)
+{
+	int w = field.xCells();
+	int h = field.yCells();
+	_xTiles = (w + _tileSize - 1) / _tileSize;
+	_yTiles = (h + _tileSize - 1) / _tileSize;
+	_tCells = field.tCells();
+	_bounds.resize(4 * _xTiles * _yTiles * _tCells);
+
+	float* bounds = _bounds.data();
+	Cg::parallelFor(_tCells, [&](int begin, int end) {
+		for (int t = begin; t < end; t++) {
+			float* b = bounds + 4 * t * _yTiles * _xTiles;
+			for (int i = 0; i < _xTiles * _yTiles; i++) {
+				b[4 * i + 0] = b[4 * i + 2] = +std::numeric_limits<float>::max();
+				b[4 * i + 1] = b[4 * i + 3] = -std::numeric_limits<float>::max();
+			}
+			const float* s = field.slice(t);
+			for (int y = 0; y < h; y++) {
+				float* row = b + 4 * (y / _tileSize) * _xTiles;
+				for (int x = 0; x < w; x++) {
+					float* tile = row + 4 * (x / _tileSize);
+					float u = s[2 * (y * w + x) + 0];
+					float v = s[2 * (y * w + x) + 1];
+					tile[0] = std::min(tile[0], u);
+					tile[1] = std::max(tile[1], u);
+					tile[2] = std::min(tile[2], v);
+					tile[3] = std::max(tile[3], v);
+				}
+			}
+		}
+	});
+}
+
+float FlowBounds::maxSpeed(int t0, int t1, float x0, float y0, float x1, float y1) const
+{
+	if (_tCells == 0)
+		return 0.0f;
+	int tx0 = std::max(int(std::floor(x0)) / _tileSize, 0);
+	int tx1 = std::min(int(std::ceil(x1)) / _tileSize, _xTiles - 1);
+	int ty0 = std::max(int(std::floor(y0)) / _tileSize, 0);
+	int ty1 = std::min(int(std::ceil(y1)) / _tileSize, _yTiles - 1);
+	t0 = std::max(t0, 0);
+	t1 = std::min(t1, _tCells - 1);
+
+	float u = 0.0f;
+	float v = 0.0f;
+	for (int t = t0; t <= t1; t++) {
+		for (int y = ty0; y <= ty1; y++) {
+			for (int x = tx0; x <= tx1; x++) {
+				const float* b = tile(t, y, x);
+				u = std::max(u, std::max(-b[0], b[1]));
+				v = std::max(v, std::max(-b[2], b[3]));
+			}
+		}
+	}
+	return std::sqrt(u * u + v * v);
+}
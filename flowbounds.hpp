@@ -0,0 +1,44 @@
+#ifndef FLOWBOUNDS_HPP
+#define FLOWBOUNDS_HPP
+
+#include <QVector>
+
+#include "flowfield.hpp"
+
+/* Bounds of the velocity components on square tiles of cells, for every time
+ * slice of a flow field. They are computed once after loading and bound how
+ * far anything can move within a tile during one step, so that stagnant
+ * regions can be recognized without integrating them. */
+class FlowBounds
+{
+private:
+	int _tileSize;
+	int _xTiles;
+	int _yTiles;
+	int _tCells;
+	QVector<float> _bounds; // uMin, uMax, vMin, vMax per tile, in [t][y][x] order
+
+public:
+	/* Create empty bounds for tiles of tileSize x tileSize cells */
+	FlowBounds(int tileSize = 8);
+
+	/* Compute the bounds of all tiles and time slices of the field */
+	void compute(const FlowField& field);
+
+	int tileSize() const { return _tileSize; }
+	int xTiles() const { return _xTiles; }
+	int yTiles() const { return _yTiles; }
+
+	/* Returns the bounds uMin, uMax, vMin, vMax of a tile in time slice t */
+	const float* tile(int t, int y, int x) const
+	{
+		return _bounds.constData() + 4 * ((t * _yTiles + y) * _xTiles + x);
+	}
+
+	/* Returns an upper bound of the speed in the time slices [t0, t1] within
+	 * the region [x0, x1] x [y0, y1] given in cell units, rounded out to
+	 * whole tiles. Returns 0 if nothing has been computed. */
+	float maxSpeed(int t0, int t1, float x0, float y0, float x1, float y1) const;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+
+#include "flowcheckpoints.hpp"
+
+
+Checkpoints::Checkpoints(qint64 memoryBudget, qint64 diskBudget) :
+	_memoryBudget(memoryBudget),
+	_diskBudget(diskBudget),
+	_memoryUsage(0),
+	_diskUsage(0)
+{
+}
+
+Checkpoints::~Checkpoints()
+{
+	clear();
+}
+
+void Checkpoints::clear()
+{
+	while (!_entries.isEmpty())
+		remove(_entries.firstKey());
+}
+
+void Checkpoints::remove(int step)
+{
+	auto it = _entries.find(step);
+	if (it == _entries.end())
+		return;
+	if (it.value().fileName.isEmpty()) {
+		_memoryUsage -= it.value().size;
+	} else {
+		QFile::remove(it.value().fileName);
+		_diskUsage -= it.value().size;
+	}
+	_entries.erase(it);
+}
+
+void Checkpoints::insert(int step, int timeCell, const char* state, int size)
+{
+	remove(step);
+	Entry e;
+	e.timeCell = timeCell;
+	// the fastest compression; snapshots are taken while the animation runs
+	e.compressed = qCompress(reinterpret_cast<const uchar*>(state), size, 1);
+	e.size = e.compressed.size();
+	_entries.insert(step, e);
+	_memoryUsage += e.size;
+	spill();
+}
+
+/* Moves the oldest snapshots in memory to disk until the memory budget is
+ * met, then drops the oldest snapshots on disk until the disk budget is met */
+void Checkpoints::spill()
+{
+	const QList<int> steps = _entries.keys();
+	for (int i = 0; i < steps.size() && _memoryUsage > _memoryBudget; i++) {
+		Entry& e = _entries[steps[i]];
+		if (!e.fileName.isEmpty())
+			continue;
+		QString fileName = QDir(QDir::tempPath()).filePath(QString("flowvis-%1-checkpoint-%2")
+				.arg(QCoreApplication::applicationPid()).arg(steps[i]));
+		QFile file(fileName);
+		if (file.open(QIODevice::WriteOnly) && file.write(e.compressed) == e.size) {
+			e.fileName = fileName;
+			e.compressed = QByteArray();
+			_memoryUsage -= e.size;
+			_diskUsage += e.size;
+		} else {
+			// the disk is not available; drop the snapshot instead
+			file.close();
+			QFile::remove(fileName);
+			remove(steps[i]);
+		}
+	}
+	for (int i = 0; i < steps.size() && _diskUsage > _diskBudget; i++) {
+		auto it = _entries.find(steps[i]);
+		if (it != _entries.end() && !it.value().fileName.isEmpty())
+			remove(steps[i]);
+	}
+}
+
+int Checkpoints::nearest(int step) const
+{
+	auto it = _entries.upperBound(step);
+	if (it == _entries.begin())
+		return -1;
+	--it;
+	return it.key();
+}
+
+QByteArray Checkpoints::state(int step, int* timeCell) const
+{
+	auto it = _entries.find(step);
+	if (it == _entries.end())
+		return QByteArray();
+	*timeCell = it.value().timeCell;
+	if (it.value().fileName.isEmpty())
+		return qUncompress(it.value().compressed);
+	QFile file(it.value().fileName);
+	if (!file.open(QIODevice::ReadOnly))
+		return QByteArray();
+	return qUncompress(file.readAll());
+}
@@ -0,0 +1,58 @@
+#ifndef FLOWCHECKPOINTS_HPP
+#define FLOWCHECKPOINTS_HPP
+
+#include <QByteArray>
+#include <QMap>
+#include <QString>
+
+/* Snapshots of the advection state, indexed by the number of advection steps
+ * since the advection was started. Snapshots are kept compressed in memory
+ * up to a budget; beyond it, the oldest ones are moved to temporary files,
+ * and beyond the disk budget, the oldest of those are dropped. */
+class Checkpoints
+{
+private:
+	struct Entry {
+		int timeCell;
+		QByteArray compressed; // empty if the snapshot is on disk
+		QString fileName;      // empty if the snapshot is in memory
+		qint64 size;           // compressed size in bytes
+	};
+
+	qint64 _memoryBudget;
+	qint64 _diskBudget;
+	qint64 _memoryUsage;
+	qint64 _diskUsage;
+	QMap<int, Entry> _entries;
+
+	void spill();
+	void remove(int step);
+
+public:
+	/* Create an empty set of checkpoints with the given budgets in bytes */
+	Checkpoints(qint64 memoryBudget, qint64 diskBudget);
+	~Checkpoints();
+
+	/* Drop all checkpoints and remove their files */
+	void clear();
+
+	/* Store the state of the given size after the given step, at the given
+	 * time cell. The state is compressed right away, so it may be in a
+	 * mapped buffer. */
+	void insert(int step, int timeCell, const char* state, int size);
+
+	bool contains(int step) const { return _entries.contains(step); }
+
+	/* Returns the largest step with a checkpoint that is not larger than
+	 * the given one, or -1 if there is none */
+	int nearest(int step) const;
+
+	/* Returns the state of a checkpoint and its time cell, or an empty
+	 * array if the checkpoint could not be read back */
+	QByteArray state(int step, int* timeCell) const;
+
+	qint64 memoryUsage() const { return _memoryUsage; }
+	qint64 diskUsage() const { return _diskUsage; }
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#include "cgbase/cgresources.hpp"
+
+#include "flowderived.hpp"
+
+
+DerivedFields::DerivedFields(const FlowField& field, float xStep, float yStep, int capacity) :
+	_field(field),
+	_xStep(xStep),
+	_yStep(yStep),
+	_capacity(capacity)
+{
+}
+
+DerivedFields::~DerivedFields()
+{
+	for (auto it = _entries.begin(); it != _entries.end(); ++it)
+		deleteTexture(it.value().texture);
+}
+
+void DerivedFields::deleteTexture(unsigned int texture)
+{
+	// Without a context the texture is gone already or will go with the context
+	if (texture != 0 && QOpenGLContext::currentContext())
+		QOpenGLContext::currentContext()->extraFunctions()->glDeleteTextures(1, &texture);
+	Cg::untrackResource(Cg::TextureResource, texture);
+}
+
+/* Looks up a cached slice and marks it as most recently used, or computes it */
+DerivedFields::Entry& DerivedFields::entry(Quantity q, int t)
+{
+	int k = key(q, t);
+	auto it = _entries.find(k);
+	if (it != _entries.end()) {
+		_lru.removeOne(k);
+		_lru.prepend(k);
+		return it.value();
+	}
+
+	Entry e;
+	e.texture = 0;
+	compute(q, t, e);
+	while (_lru.size() >= _capacity) {
+		int oldest = _lru.takeLast();
+		deleteTexture(_entries[oldest].texture);
+		_entries.remove(oldest);
+	}
+	_lru.prepend(k);
+	return _entries.insert(k, e).value();
+}
+
+/* Central differences in the interior and one-sided differences at the
+ * borders. Each row is a plain loop over contiguous memory without branches,
+ * so that the compiler can vectorize it. */
+void DerivedFields::computeJacobian(int t, QVector<float>& jacobian) const
+{
+	int w = _field.xCells();
+	int h = _field.yCells();
+	const float* s = _field.slice(t);
+	jacobian.resize(4 * w * h);
+	float* out = jacobian.data();
+	float invDx2 = 1.0f / (2.0f * _xStep);
+	float invDx1 = 1.0f / _xStep;
+
+	for (int y = 0; y < h; y++) {
+		int yBelow = std::max(y - 1, 0);
+		int yAbove = std::min(y + 1, h - 1);
+		float invDy = 1.0f / ((yAbove - yBelow) * _yStep);
+		const float* row = s + 2 * y * w;
+		const float* below = s + 2 * yBelow * w;
+		const float* above = s + 2 * yAbove * w;
+		float* j = out + 4 * y * w;
+		for (int x = 0; x < w; x++) {
+			j[4 * x + 1] = (above[2 * x + 0] - below[2 * x + 0]) * invDy;
+			j[4 * x + 3] = (above[2 * x + 1] - below[2 * x + 1]) * invDy;
+		}
+		for (int x = 1; x < w - 1; x++) {
+			j[4 * x + 0] = (row[2 * x + 2] - row[2 * x - 2]) * invDx2;
+			j[4 * x + 2] = (row[2 * x + 3] - row[2 * x - 1]) * invDx2;
+		}
+		j[0] = (row[2] - row[0]) * invDx1;
+		j[2] = (row[3] - row[1]) * invDx1;
+		j[4 * (w - 1) + 0] = (row[2 * (w - 1) + 0] - row[2 * (w - 2) + 0]) * invDx1;
+		j[4 * (w - 1) + 2] = (row[2 * (w - 1) + 1] - row[2 * (w - 2) + 1]) * invDx1;
+	}
+}
+
+void DerivedFields::compute(Quantity q, int t, Entry& e)
+{
+	int cells = _field.xCells() * _field.yCells();
+	if (q == Jacobian) {
+		computeJacobian(t, e.values);
+	} else if (q == Magnitude) {
+		const float* s = _field.slice(t);
+		e.values.resize(cells);
+		float* out = e.values.data();
+		for (int i = 0; i < cells; i++)
+			out[i] = std::sqrt(s[2 * i + 0] * s[2 * i + 0] + s[2 * i + 1] * s[2 * i + 1]);
+	} else {
+		const float* j = data(Jacobian, t).constData();
+		e.values.resize(cells);
+		float* out = e.values.data();
+		if (q == Vorticity) {
+			for (int i = 0; i < cells; i++)
+				out[i] = j[4 * i + 2] - j[4 * i + 1];
+		} else {
+			for (int i = 0; i < cells; i++)
+				out[i] = j[4 * i + 0] + j[4 * i + 3];
+		}
+	}
+
+	e.minValue = +std::numeric_limits<float>::max();
+	e.maxValue = -std::numeric_limits<float>::max();
+	if (q != Jacobian) {
+		for (int i = 0; i < e.values.size(); i++) {
+			e.minValue = std::min(e.minValue, e.values[i]);
+			e.maxValue = std::max(e.maxValue, e.values[i]);
+		}
+	}
+}
+
+const QVector<float>& DerivedFields::data(Quantity q, int t)
+{
+	return entry(q, t).values;
+}
+
+void DerivedFields::range(Quantity q, int t, float* minValue, float* maxValue)
+{
+	Q_ASSERT(q != Jacobian);
+	const Entry& e = entry(q, t);
+	*minValue = e.minValue;
+	*maxValue = e.maxValue;
+}
+
+unsigned int DerivedFields::texture(Quantity q, int t)
+{
+	Entry& e = entry(q, t);
+	if (e.texture == 0) {
+		QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+		gl->glGenTextures(1, &e.texture);
+		gl->glBindTexture(GL_TEXTURE_2D, e.texture);
+		gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		if (q == Jacobian)
+			gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, _field.xCells(), _field.yCells(), 0,
+				GL_RGBA, GL_FLOAT, e.values.constData());
+		else
+			gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, _field.xCells(), _field.yCells(), 0,
+				GL_RED, GL_FLOAT, e.values.constData());
+		Cg::trackResource(Cg::TextureResource, e.texture,
+			Cg::textureBytes(q == Jacobian ? GL_RGBA32F : GL_R32F, _field.xCells(), _field.yCells()));
+	}
+	return e.texture;
+}
+
+void DerivedFields::clear()
+{
+	for (auto it = _entries.begin(); it != _entries.end(); ++it)
+		deleteTexture(it.value().texture);
+	_entries.clear();
+	_lru.clear();
+}
@@ -0,0 +1,69 @@
+#ifndef FLOWDERIVED_HPP
+#define FLOWDERIVED_HPP
+
+#include <QHash>
+#include <QList>
+#include <QVector>
+
+#include "flowfield.hpp"
+
+/* Quantities derived from a flow field, computed lazily per time slice with
+ * finite differences and kept in a cache with least-recently-used eviction.
+ * The same computation serves the CPU (data()) and the GPU (texture()), and
+ * vorticity and divergence reuse the cached Jacobian. */
+class DerivedFields
+{
+public:
+	enum Quantity {
+		Magnitude,  // |v|, one value per cell
+		Vorticity,  // dv/dx - du/dy, one value per cell
+		Divergence, // du/dx + dv/dy, one value per cell
+		Jacobian    // du/dx, du/dy, dv/dx, dv/dy: four values per cell
+	};
+
+private:
+	struct Entry {
+		QVector<float> values;
+		float minValue;
+		float maxValue;
+		unsigned int texture;
+	};
+
+	const FlowField& _field;
+	float _xStep;
+	float _yStep;
+	int _capacity;
+	QHash<int, Entry> _entries;
+	QList<int> _lru; // most recently used key first
+
+	int key(Quantity q, int t) const { return q * _field.tCells() + t; }
+	Entry& entry(Quantity q, int t);
+	void compute(Quantity q, int t, Entry& e);
+	void computeJacobian(int t, QVector<float>& jacobian) const;
+	static void deleteTexture(unsigned int texture);
+
+public:
+	/* Create a cache for the given field with cell sizes xStep and yStep
+	 * that holds up to capacity slices of derived quantities. The field is
+	 * referenced, not copied. */
+	DerivedFields(const FlowField& field, float xStep, float yStep, int capacity = 64);
+	~DerivedFields();
+
+	/* Returns a quantity of time slice t in the same cell order as the flow
+	 * data. The reference is valid until the slice is evicted. */
+	const QVector<float>& data(Quantity q, int t);
+
+	/* Returns the value range of a scalar quantity of time slice t */
+	void range(Quantity q, int t, float* minValue, float* maxValue);
+
+	/* Returns a texture with a quantity of time slice t: GL_R32F for scalar
+	 * quantities and GL_RGBA32F for the Jacobian. The texture is owned by the
+	 * cache and is only valid until the slice is evicted.
+	 * Needs a current OpenGL context. */
+	unsigned int texture(Quantity q, int t);
+
+	/* Drop all cached slices. Needs a current OpenGL context if textures were created. */
+	void clear();
+};
+
+#endif
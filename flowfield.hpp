@@ -0,0 +1,85 @@
+#ifndef FLOWFIELD_HPP
+#define FLOWFIELD_HPP
+
+#include <algorithm>
+#include <cmath>
+
+#include <QVector2D>
+
+/* Read-only view of a time-dependent 2D flow data set. The data is stored as
+ * (u, v) pairs in [t][y][x] order, positions are given in cell units and
+ * times in time cell units. All functions are const and can be used from
+ * several threads at once. */
+class FlowField
+{
+private:
+	const float* _data;
+	int _xCells;
+	int _yCells;
+	int _tCells;
+
+public:
+	FlowField(const float* data, int xCells, int yCells, int tCells) :
+		_data(data), _xCells(xCells), _yCells(yCells), _tCells(tCells)
+	{
+	}
+
+	int xCells() const { return _xCells; }
+	int yCells() const { return _yCells; }
+	int tCells() const { return _tCells; }
+
+	/* Returns the (u, v) pairs of time slice t */
+	const float* slice(int t) const
+	{
+		return _data + 2 * t * _yCells * _xCells;
+	}
+
+	/* Returns the flow vector stored in a cell */
+	QVector2D at(int t, int y, int x) const
+	{
+		const float* f = _data + 2 * (t * _yCells * _xCells + y * _xCells + x);
+		return QVector2D(f[0], f[1]);
+	}
+
+	/* Bilinearly interpolates coordinates before getting the flow vector */
+	QVector2D sample(float x, float y, float t) const
+	{
+		int ct = std::round(t);
+		ct = std::min(std::max(ct, 0), _tCells - 1);
+
+		// Biliniear Interpolation in 2D as it is described in the SciVis script part 02 page 20
+		int x00 = std::floor(x);
+		x00 = std::min(std::max(x00, 0), _xCells - 1);
+		int x10 = std::ceil(x);
+		x10 = std::min(std::max(x10, 0), _xCells - 1);
+		int y00 = std::floor(y);
+		y00 = std::min(std::max(y00, 0), _yCells - 1);
+		int y01 = std::ceil(y);
+		y01 = std::min(std::max(y01, 0), _yCells - 1);
+		QVector2D f00 = at(ct, y00, x00);
+		QVector2D f10 = at(ct, y00, x10);
+		QVector2D f01 = at(ct, y01, x00);
+		QVector2D f11 = at(ct, y01, x10);
+		float alpha = 0.0f;
+		if (x10 - x00 != 0)
+			alpha = (x - x00) / (x10 - x00);
+		QVector2D f0 = alpha * f10 + (1 - alpha) * f00;
+		QVector2D f1 = alpha * f11 + (1 - alpha) * f01;
+
+		float beta = 0.0f;
+		if (y01 - y00 != 0)
+			beta = (y - y00) / (y01 - y00);
+		return beta * f1 + (1 - beta) * f0;
+	}
+
+	/* Use Heun integration to better approximate flow vectors */
+	QVector2D heun(float stepSize, QVector2D position, float t) const
+	{
+		QVector2D speed = sample(position.x(), position.y(), t);
+		QVector2D result = position + stepSize * speed;
+		QVector2D speedNext = sample(result.x(), result.y(), t + stepSize);
+		return position + (stepSize * 0.5f * (speed + speedNext));
+	}
+};
+
+#endif
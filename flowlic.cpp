@@ -0,0 +1,209 @@
+#include <cmath>
+
+#include "cgbase/cgtools.hpp"
+
+#include "flowlic.hpp"
+
+
+static const int tileSize = 64;
+static const float stepSize = 0.5f; // in pixels
+
+/* Returns the normalized flow direction at a pixel position, in pixel units */
+static bool direction(const FlowField& field, float t, float sx, float sy,
+		float px, float py, float* dx, float* dy)
+{
+	QVector2D v = field.sample(px * sx, py * sy, t);
+	float vx = v.x() / sx;
+	float vy = v.y() / sy;
+	float length = std::sqrt(vx * vx + vy * vy);
+	if (length < 1e-6f)
+		return false;
+	*dx = vx / length;
+	*dy = vy / length;
+	return true;
+}
+
+/* Follows a streamline from a pixel center with midpoint integration and
+ * appends the pixels it passes to points */
+static void traceStreamline(const FlowField& field, float t, int width, int height,
+		int x, int y, float step, int maxSteps, QVector<quint32>& points)
+{
+	float sx = static_cast<float>(field.xCells()) / width;
+	float sy = static_cast<float>(field.yCells()) / height;
+	float px = x + 0.5f;
+	float py = y + 0.5f;
+	for (int i = 0; i < maxSteps; i++) {
+		float dx, dy;
+		if (!direction(field, t, sx, sy, px, py, &dx, &dy))
+			break;
+		if (!direction(field, t, sx, sy, px + 0.5f * step * dx, py + 0.5f * step * dy, &dx, &dy))
+			break;
+		px += step * dx;
+		py += step * dy;
+		if (px < 0.0f || py < 0.0f || px >= width || py >= height)
+			break;
+		points.append(static_cast<int>(py) * width + static_cast<int>(px));
+	}
+}
+
+FlowLIC::FlowLIC() :
+	_kernelLength(30),
+	_depositLength(40),
+	_width(0),
+	_height(0),
+	_timeCell(-1),
+	_traced(false),
+	_convolved(false)
+{
+}
+
+void FlowLIC::setNoise(const QImage& noise)
+{
+	_noiseImage = noise.convertToFormat(QImage::Format_Grayscale8);
+	resampleNoise();
+	_convolved = false;
+}
+
+/* Tiles the noise image over the LIC image */
+void FlowLIC::resampleNoise()
+{
+	_noise.resize(_width * _height);
+	int nw = _noiseImage.width();
+	int nh = _noiseImage.height();
+	for (int y = 0; y < _height; y++) {
+		const uchar* line = _noiseImage.isNull() ? nullptr : _noiseImage.constScanLine(y % nh);
+		for (int x = 0; x < _width; x++)
+			_noise[y * _width + x] = line ? line[x % nw] / 255.0f : 0.5f;
+	}
+}
+
+/* Seeds streamlines in all pixels of the tile that no streamline covers yet */
+void FlowLIC::trace(const FlowField& field, Tile& tile) const
+{
+	int tileWidth = tile.x1 - tile.x0;
+	QVector<bool> covered(tileWidth * (tile.y1 - tile.y0), false);
+	QVector<quint32> backward;
+	int maxSteps = _kernelLength + _depositLength;
+
+	tile.points.clear();
+	tile.lines.clear();
+	for (int y = tile.y0; y < tile.y1; y++) {
+		for (int x = tile.x0; x < tile.x1; x++) {
+			if (covered[(y - tile.y0) * tileWidth + (x - tile.x0)])
+				continue;
+			Streamline line;
+			line.begin = tile.points.size();
+			backward.clear();
+			traceStreamline(field, _timeCell, _width, _height, x, y, -stepSize, maxSteps, backward);
+			for (int i = backward.size() - 1; i >= 0; i--)
+				tile.points.append(backward[i]);
+			int seed = tile.points.size();
+			tile.points.append(y * _width + x);
+			traceStreamline(field, _timeCell, _width, _height, x, y, +stepSize, maxSteps, tile.points);
+			line.count = tile.points.size() - line.begin;
+			line.depositBegin = std::max(seed - _depositLength, line.begin);
+			line.depositEnd = std::min(seed + _depositLength + 1, line.begin + line.count);
+			for (int i = line.depositBegin; i < line.depositEnd; i++) {
+				int px = tile.points[i] % _width;
+				int py = tile.points[i] / _width;
+				if (px >= tile.x0 && px < tile.x1 && py >= tile.y0 && py < tile.y1)
+					covered[(py - tile.y0) * tileWidth + (px - tile.x0)] = true;
+			}
+			tile.lines.append(line);
+		}
+	}
+}
+
+/* Box filters the noise along the streamlines of a tile and averages all
+ * values deposited into each of its pixels */
+void FlowLIC::convolve(Tile& tile)
+{
+	int tileWidth = tile.x1 - tile.x0;
+	int tileHeight = tile.y1 - tile.y0;
+	QVector<float> accum(tileWidth * tileHeight, 0.0f);
+	QVector<int> hits(tileWidth * tileHeight, 0);
+	QVector<float> prefix;
+
+	for (int l = 0; l < tile.lines.size(); l++) {
+		const Streamline& line = tile.lines[l];
+		prefix.resize(line.count + 1);
+		prefix[0] = 0.0f;
+		for (int i = 0; i < line.count; i++)
+			prefix[i + 1] = prefix[i] + _noise[tile.points[line.begin + i]];
+		for (int k = line.depositBegin; k < line.depositEnd; k++) {
+			int px = tile.points[k] % _width;
+			int py = tile.points[k] / _width;
+			if (px < tile.x0 || px >= tile.x1 || py < tile.y0 || py >= tile.y1)
+				continue;
+			int j = k - line.begin;
+			int lo = std::max(j - _kernelLength, 0);
+			int hi = std::min(j + _kernelLength, line.count - 1);
+			int local = (py - tile.y0) * tileWidth + (px - tile.x0);
+			accum[local] += (prefix[hi + 1] - prefix[lo]) / (hi - lo + 1);
+			hits[local]++;
+		}
+	}
+	for (int y = 0; y < tileHeight; y++) {
+		for (int x = 0; x < tileWidth; x++) {
+			int local = y * tileWidth + x;
+			_result[(tile.y0 + y) * _width + (tile.x0 + x)] =
+				hits[local] > 0 ? accum[local] / hits[local] : 0.5f;
+		}
+	}
+}
+
+bool FlowLIC::update(const FlowField& field, int t, int width, int height)
+{
+	if (width != _width || height != _height) {
+		_width = width;
+		_height = height;
+		_tiles.clear();
+		for (int y = 0; y < _height; y += tileSize) {
+			for (int x = 0; x < _width; x += tileSize) {
+				Tile tile;
+				tile.x0 = x;
+				tile.y0 = y;
+				tile.x1 = std::min(x + tileSize, _width);
+				tile.y1 = std::min(y + tileSize, _height);
+				_tiles.append(tile);
+			}
+		}
+		_result.resize(_width * _height);
+		_image.resize(_width * _height);
+		resampleNoise();
+		_traced = false;
+	}
+	if (t != _timeCell) {
+		_timeCell = t;
+		_traced = false;
+	}
+	if (_traced && _convolved)
+		return false;
+
+	if (!_traced) {
+		Cg::parallelFor(_tiles.size(), [&](int begin, int end) {
+				for (int i = begin; i < end; i++)
+					trace(field, _tiles[i]);
+			});
+		_traced = true;
+	}
+	Cg::parallelFor(_tiles.size(), [&](int begin, int end) {
+			for (int i = begin; i < end; i++)
+				convolve(_tiles[i]);
+		});
+	_convolved = true;
+
+	// Stretch the contrast, which the convolution reduces
+	double sum = 0.0, sumSq = 0.0;
+	for (int i = 0; i < _result.size(); i++) {
+		sum += _result[i];
+		sumSq += _result[i] * _result[i];
+	}
+	float mean = sum / _result.size();
+	float deviation = std::sqrt(std::max(sumSq / _result.size() - mean * mean, 1e-8));
+	for (int i = 0; i < _result.size(); i++) {
+		float v = 128.0f + 48.0f * (_result[i] - mean) / deviation;
+		_image[i] = std::min(std::max(v, 0.0f), 255.0f);
+	}
+	return true;
+}
@@ -0,0 +1,68 @@
+#ifndef FLOWLIC_HPP
+#define FLOWLIC_HPP
+
+#include <QImage>
+#include <QVector>
+
+#include "flowfield.hpp"
+
+/* Line Integral Convolution of a noise image along the streamlines of one
+ * time slice, using the FastLIC approach: each traced streamline deposits
+ * box filtered noise values into all pixels along its central part, so only
+ * pixels that were not yet hit by a streamline start a new one.
+ * The image is split into tiles that are processed in parallel; a tile
+ * traces streamlines through the whole domain, but only writes its own
+ * pixels. The traced streamlines are kept, so changing the noise image or
+ * computing the same slice again does not require tracing. */
+class FlowLIC
+{
+private:
+	struct Streamline {
+		int begin;         // first point in Tile::points
+		int count;         // number of points
+		int depositBegin;  // first point that deposits its value
+		int depositEnd;    // one after the last point that deposits its value
+	};
+	struct Tile {
+		int x0, y0, x1, y1;
+		QVector<quint32> points; // pixel indices of all streamline points
+		QVector<Streamline> lines;
+	};
+
+	// Parameters, in streamline steps of half a pixel
+	int _kernelLength;
+	int _depositLength;
+	// State
+	int _width;
+	int _height;
+	int _timeCell;
+	bool _traced;
+	bool _convolved;
+	QImage _noiseImage;
+	QVector<float> _noise;
+	QVector<Tile> _tiles;
+	QVector<float> _result;
+	QVector<unsigned char> _image;
+
+	void resampleNoise();
+	void trace(const FlowField& field, Tile& tile) const;
+	void convolve(Tile& tile);
+
+public:
+	FlowLIC();
+
+	/* Set the noise image to convolve. It is tiled over the LIC image. */
+	void setNoise(const QImage& noise);
+
+	/* Compute the LIC image of time slice t with the given size. Returns
+	 * true if the image changed, and false if the previous one is still
+	 * valid. */
+	bool update(const FlowField& field, int t, int width, int height);
+
+	/* The LIC image: width * height gray values, bottom row first */
+	const QVector<unsigned char>& image() const { return _image; }
+	int width() const { return _width; }
+	int height() const { return _height; }
+};
+
+#endif
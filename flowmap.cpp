@@ -0,0 +1,132 @@
+#include <algorithm>
+
+#include "cgbase/cgtools.hpp"
+
+#include "flowmap.hpp"
+
+
+FlowMaps::FlowMaps(const FlowField& field, float stepSize, int capacity) :
+	_field(field),
+	_stepSize(stepSize),
+	_capacity(capacity)
+{
+}
+
+void FlowMaps::setStepSize(float stepSize)
+{
+	if (stepSize != _stepSize) {
+		_stepSize = stepSize;
+		clear();
+	}
+}
+
+void FlowMaps::clear()
+{
+	_nodes.clear();
+	_lru.clear();
+}
+
+/* The map over slice t, one Heun step per node */
+QVector<float> FlowMaps::sliceMap(int t) const
+{
+	int w = xNodes();
+	QVector<float> map(2 * w * yNodes());
+	float* out = map.data();
+	Cg::parallelFor(yNodes(), [&](int begin, int end) {
+		for (int y = begin; y < end; y++) {
+			for (int x = 0; x < w; x++) {
+				QVector2D p = _field.heun(_stepSize, QVector2D(x, y), t);
+				out[2 * (y * w + x) + 0] = p.x();
+				out[2 * (y * w + x) + 1] = p.y();
+			}
+		}
+	});
+	return map;
+}
+
+QVector2D FlowMaps::sample(const QVector<float>& map, QVector2D position) const
+{
+	int w = xNodes();
+	int h = yNodes();
+	float x = std::min(std::max(position.x(), 0.0f), float(w - 1));
+	float y = std::min(std::max(position.y(), 0.0f), float(h - 1));
+	int x0 = std::min(static_cast<int>(x), w - 2);
+	int y0 = std::min(static_cast<int>(y), h - 2);
+	float a = x - x0;
+	float b = y - y0;
+	const float* m = map.constData();
+	const float* p00 = m + 2 * (y0 * w + x0);
+	const float* p01 = p00 + 2 * w;
+	QVector2D v0 = (1.0f - a) * QVector2D(p00[0], p00[1]) + a * QVector2D(p00[2], p00[3]);
+	QVector2D v1 = (1.0f - a) * QVector2D(p01[0], p01[1]) + a * QVector2D(p01[2], p01[3]);
+	// the clamped point moves like the border; carry the rest along
+	return (1.0f - b) * v0 + b * v1 + (position - QVector2D(x, y));
+}
+
+/* The map that applies first, then second */
+QVector<float> FlowMaps::compose(const QVector<float>& first, const QVector<float>& second) const
+{
+	int n = xNodes() * yNodes();
+	QVector<float> map(2 * n);
+	float* out = map.data();
+	Cg::parallelFor(n, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			QVector2D p = sample(second, QVector2D(first[2 * i + 0], first[2 * i + 1]));
+			out[2 * i + 0] = p.x();
+			out[2 * i + 1] = p.y();
+		}
+	}, 1024);
+	return map;
+}
+
+QVector<float> FlowMaps::node(int level, int index)
+{
+	qint64 k = key(level, index);
+	auto it = _nodes.find(k);
+	if (it != _nodes.end()) {
+		_lru.removeOne(k);
+		_lru.prepend(k);
+		return it.value();
+	}
+
+	QVector<float> map;
+	if (level == 0)
+		map = sliceMap(index);
+	else
+		map = compose(node(level - 1, 2 * index), node(level - 1, 2 * index + 1));
+	while (_lru.size() >= _capacity)
+		_nodes.remove(_lru.takeLast());
+	_lru.prepend(k);
+	_nodes.insert(k, map);
+	return map;
+}
+
+QVector<float> FlowMaps::map(int t0, int t1)
+{
+	Q_ASSERT(t0 >= 0 && t0 <= t1 && t1 < _field.tCells());
+	if (t0 == t1) {
+		// the identity
+		int w = xNodes();
+		QVector<float> map(2 * w * yNodes());
+		for (int y = 0; y < yNodes(); y++) {
+			for (int x = 0; x < w; x++) {
+				map[2 * (y * w + x) + 0] = x;
+				map[2 * (y * w + x) + 1] = y;
+			}
+		}
+		return map;
+	}
+
+	// Cover [t0, t1) with the largest aligned intervals of the tree, from left to right
+	QVector<float> result;
+	int t = t0;
+	while (t < t1) {
+		int level = 0;
+		while ((t & ((2 << level) - 1)) == 0 && t + (2 << level) <= t1)
+			level++;
+		QVector<float> m = node(level, t >> level);
+		result = result.isEmpty() ? m : compose(result, m);
+		t += 1 << level;
+	}
+	return result;
+}
@@ -0,0 +1,57 @@
+#ifndef FLOWMAP_HPP
+#define FLOWMAP_HPP
+
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <QVector2D>
+
+#include "flowfield.hpp"
+
+/* Flow maps of a flow field: for each node of the cell grid, the position in
+ * cell units that a particle starting there reaches after some time slices.
+ * The map over one slice is one Heun step, as in the mesh advection. Maps
+ * over longer intervals are composed from these by interpolation in a binary
+ * tree: the node at level l and index k covers slices [k 2^l, (k+1) 2^l) and
+ * is the composition of its two children. Nodes are computed when first
+ * needed and kept in a cache with least-recently-used eviction, so that a
+ * query for any interval takes O(log n) compositions. */
+class FlowMaps
+{
+private:
+	const FlowField& _field;
+	float _stepSize;
+	int _capacity;
+	QHash<qint64, QVector<float>> _nodes;
+	QList<qint64> _lru; // most recently used key first
+
+	static qint64 key(int level, int index) { return (qint64(level) << 32) | index; }
+	QVector<float> node(int level, int index);
+	QVector<float> sliceMap(int t) const;
+	QVector<float> compose(const QVector<float>& first, const QVector<float>& second) const;
+
+public:
+	/* Create flow maps for the given field, with the given step size per
+	 * slice, keeping up to capacity maps in the cache. The field is
+	 * referenced, not copied. */
+	FlowMaps(const FlowField& field, float stepSize, int capacity = 512);
+
+	int xNodes() const { return _field.xCells() + 1; }
+	int yNodes() const { return _field.yCells() + 1; }
+
+	/* Change the step size per slice. This drops the cache if it differs. */
+	void setStepSize(float stepSize);
+
+	/* Returns the flow map from slice t0 to slice t1, with 0 <= t0 <= t1 <
+	 * tCells: two values per node, in row order */
+	QVector<float> map(int t0, int t1);
+
+	/* Interpolates a flow map bilinearly at a position in cell units. Outside
+	 * of the grid, the displacement of the nearest border point is used. */
+	QVector2D sample(const QVector<float>& map, QVector2D position) const;
+
+	/* Drop all cached maps */
+	void clear();
+};
+
+#endif
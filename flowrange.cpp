@@ -0,0 +1,190 @@
+#include <QOpenGLContext>
+
+#include "cgbase/cgprograms.hpp"
+#include "cgbase/cgresources.hpp"
+#include "cgbase/cgtools.hpp"
+
+#include "flowrange.hpp"
+
+
+FlowRange::FlowRange() :
+	_vao(0),
+	_fbo(0),
+	_next(0),
+	_valid(false),
+	_min(0.0f),
+	_max(0.0f)
+{
+	_pbo[0] = _pbo[1] = 0;
+	_fence[0] = _fence[1] = 0;
+}
+
+FlowRange::~FlowRange()
+{
+	// Without a context the objects are gone already or will go with the context
+	if (QOpenGLContext::currentContext())
+		destroy();
+}
+
+void FlowRange::destroy()
+{
+	if (_vao == 0)
+		return;
+	QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+	deleteLevels();
+	_inputSize = QSize();
+	for (int i = 0; i < 2; i++) {
+		if (_fence[i])
+			gl->glDeleteSync(_fence[i]);
+		_fence[i] = 0;
+	}
+	gl->glDeleteBuffers(2, _pbo);
+	gl->glDeleteFramebuffers(1, &_fbo);
+	gl->glDeleteVertexArrays(1, &_vao);
+	Cg::untrackResource(Cg::BufferResource, _pbo[0]);
+	Cg::untrackResource(Cg::BufferResource, _pbo[1]);
+	Cg::untrackResource(Cg::FramebufferResource, _fbo);
+	Cg::untrackResource(Cg::VertexArrayResource, _vao);
+	_pbo[0] = _pbo[1] = 0;
+	_fbo = 0;
+	_vao = 0;
+}
+
+void FlowRange::initialize()
+{
+	QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+	Cg::buildProgram(_prg, ":vsReduce.glsl", ":fsReduce.glsl");
+	// the vertex shader needs no attributes, but a vertex array must be bound
+	gl->glGenVertexArrays(1, &_vao);
+	gl->glGenFramebuffers(1, &_fbo);
+	gl->glGenBuffers(2, _pbo);
+	for (int i = 0; i < 2; i++) {
+		gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo[i]);
+		gl->glBufferData(GL_PIXEL_PACK_BUFFER, 2 * sizeof(float), nullptr, GL_STREAM_READ);
+		Cg::trackResource(Cg::BufferResource, _pbo[i], 2 * sizeof(float));
+	}
+	Cg::trackResource(Cg::FramebufferResource, _fbo);
+	Cg::trackResource(Cg::VertexArrayResource, _vao);
+	gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	CG_ASSERT_GLCHECK();
+}
+
+/* Each level has half the size of the previous one, rounded up, down to 1x1 */
+void FlowRange::createLevels(int width, int height)
+{
+	QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+	deleteLevels();
+	_inputSize = QSize(width, height);
+	while (width > 1 || height > 1) {
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+		unsigned int texture;
+		gl->glGenTextures(1, &texture);
+		gl->glBindTexture(GL_TEXTURE_2D, texture);
+		gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, width, height, 0, GL_RG, GL_FLOAT, nullptr);
+		Cg::trackResource(Cg::TextureResource, texture, Cg::textureBytes(GL_RG32F, width, height));
+		_levels.append(texture);
+		_levelSizes.append(QSize(width, height));
+	}
+	CG_ASSERT_GLCHECK();
+}
+
+void FlowRange::deleteLevels()
+{
+	if (_levels.size() > 0)
+		QOpenGLContext::currentContext()->extraFunctions()->glDeleteTextures(_levels.size(), _levels.constData());
+	for (int i = 0; i < _levels.size(); i++)
+		Cg::untrackResource(Cg::TextureResource, _levels[i]);
+	_levels.clear();
+	_levelSizes.clear();
+}
+
+void FlowRange::reduce(unsigned int texture, int width, int height)
+{
+	QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+	if (_vao == 0)
+		initialize();
+	if (_inputSize != QSize(width, height))
+		createLevels(width, height);
+	// both pixel buffers are still in flight: skip this request
+	fetch();
+	if (_fence[_next])
+		return;
+
+	int buffer;
+	GLint viewport[4];
+	gl->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &buffer);
+	gl->glGetIntegerv(GL_VIEWPORT, viewport);
+	GLboolean blend = gl->glIsEnabled(GL_BLEND);
+	GLboolean depthTest = gl->glIsEnabled(GL_DEPTH_TEST);
+	gl->glDisable(GL_BLEND);
+	gl->glDisable(GL_DEPTH_TEST);
+
+	_prg.bind();
+	_prg.setUniformValue("tex", 0);
+	gl->glBindVertexArray(_vao);
+	gl->glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+	QSize inputSize = _inputSize;
+	for (int l = 0; l < _levels.size(); l++) {
+		gl->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _levels[l], 0);
+		gl->glViewport(0, 0, _levelSizes[l].width(), _levelSizes[l].height());
+		gl->glBindTexture(GL_TEXTURE_2D, l == 0 ? texture : _levels[l - 1]);
+		// the first level turns flow vectors into magnitudes
+		_prg.setUniformValue("first_level", l == 0 ? 1 : 0);
+		gl->glUniform2i(_prg.uniformLocation("input_size"), inputSize.width(), inputSize.height());
+		gl->glDrawArrays(GL_TRIANGLES, 0, 3);
+		inputSize = _levelSizes[l];
+	}
+
+	// read the last level into a pixel buffer without waiting for it
+	gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo[_next]);
+	gl->glReadPixels(0, 0, 1, 1, GL_RG, GL_FLOAT, nullptr);
+	gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	_fence[_next] = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	_next = !_next;
+
+	gl->glBindFramebuffer(GL_FRAMEBUFFER, buffer);
+	gl->glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	if (blend)
+		gl->glEnable(GL_BLEND);
+	if (depthTest)
+		gl->glEnable(GL_DEPTH_TEST);
+	CG_ASSERT_GLCHECK();
+}
+
+/* Takes the results out of all pixel buffers whose fence has signaled, oldest first */
+void FlowRange::fetch()
+{
+	QOpenGLExtraFunctions* gl = QOpenGLContext::currentContext()->extraFunctions();
+	for (int j = 0; j < 2; j++) {
+		int i = (_next + j) % 2;
+		if (!_fence[i])
+			continue;
+		GLenum status = gl->glClientWaitSync(_fence[i], 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		gl->glDeleteSync(_fence[i]);
+		_fence[i] = 0;
+		gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo[i]);
+		const float* range = static_cast<const float*>(
+				gl->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 2 * sizeof(float), GL_MAP_READ_BIT));
+		if (range) {
+			_min = range[0];
+			_max = range[1];
+			_valid = true;
+			gl->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+}
+
+bool FlowRange::range(float* minValue, float* maxValue)
+{
+	if (_vao != 0)
+		fetch();
+	*minValue = _min;
+	*maxValue = _max;
+	return _valid;
+}
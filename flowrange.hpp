@@ -0,0 +1,54 @@
+#ifndef FLOWRANGE_HPP
+#define FLOWRANGE_HPP
+
+#include <QOpenGLShaderProgram>
+#include <QOpenGLExtraFunctions>
+#include <QSize>
+#include <QVector>
+
+/* Computes the range of flow magnitudes in an RG32F texture of flow vectors
+ * on the GPU, by reducing it to a single texel with a chain of framebuffers
+ * of half the size each. The result is read back through two pixel buffers
+ * that are used in turn and guarded by fences, so that the CPU never waits
+ * for the GPU: a range becomes available one or two frames after it was
+ * requested, and until then the previous one is kept. */
+class FlowRange
+{
+private:
+	QOpenGLShaderProgram _prg;
+	unsigned int _vao;
+	unsigned int _fbo;
+	QSize _inputSize;
+	QVector<unsigned int> _levels; // textures of the reduction chain
+	QVector<QSize> _levelSizes;
+	unsigned int _pbo[2];
+	GLsync _fence[2];
+	int _next;    // the pixel buffer to use for the next reduction
+	bool _valid;
+	float _min;
+	float _max;
+
+	void initialize();
+	void createLevels(int width, int height);
+	void deleteLevels();
+	void fetch();
+
+public:
+	FlowRange();
+	~FlowRange();
+
+	/* Start the reduction of the given flow texture of size width x height.
+	 * Needs a current OpenGL context. Changes the texture binding of the
+	 * active texture unit. */
+	void reduce(unsigned int texture, int width, int height);
+
+	/* Get the most recent range that has arrived. Returns false if there is
+	 * none yet. Needs a current OpenGL context. */
+	bool range(float* minValue, float* maxValue);
+
+	/* Delete the OpenGL objects; the next reduction creates them anew.
+	 * Needs a current OpenGL context. */
+	void destroy();
+};
+
+#endif
@@ -3,11 +3,17 @@
 #include <cstdio>
 
 #include <QApplication>
+#include <QAtomicInt>
 #include <QSurfaceFormat>
+#include <QOpenGLContext>
 #include <QKeyEvent>
+#include <QFile>
 #include <QtMath>
+#include <QVector4D>
 
 #include "cgbase/cggeometries.hpp"
+#include "cgbase/cgprograms.hpp"
+#include "cgbase/cgresources.hpp"
 #include "cgbase/cgtools.hpp"
 
 #include "flowvis.hpp"
@@ -15,19 +21,51 @@
 
 
 FlowVis::FlowVis() :
+	_field(nullptr, _x_cells, _y_cells, _t_cells),
+	_derived(_field, _x_step, _y_step),
+	_flowMaps(_field, 0.5f),
 	_time_cell(0),
 	_time_cell_in_texture(-1),
 	_first_iteration(true),
 	_meshIteration(false),
 	_time_is_passing(true),
 	_blendOn(true),
-	_indexCount(0),
+	_adaptiveMesh(false),
+	_substepsPerFrame(1.0f),
+	_substepBudget(0.0f),
+	_pixelAdvection(false),
+	_noiseType(0),
+	_noiseSeed(0),
+	_compareSeeds(false),
+	_licMode(0),
+	_fieldView(0),
+	_resolutionMode(0),
+	_advectionWidth(800),
+	_advectionHeight(600),
+	_posterRequested(false),
+	_checkpoints(_checkpointMemoryBudget, _checkpointDiskBudget),
+	_checkpointNext(0),
+	_step(0),
+	_seekStep(-1),
+	_reversePlayback(false),
+	_useBake(false),
+	_vaoBaked(0),
+	_indexCountBaked(0),
+	_cullStatic(true),
+	_vaoStatic(0),
+	_staticMeshSize(0),
+	_ftleTexture(0),
+	_ftleTime(-1),
+	_ftleStepSize(0.0f),
+	_ftleMax(0.0f),
 	_vaoMesh(0),
 	_indexCountMesh(0),
+	_vaoQuad(0),
 	_nMesh(20),
 	_stepSize(0.5f),
-	_screenWidth(800),
-	_screenHeight(600)
+	_getQueryObjectui64v(nullptr),
+	_timerQuery(0),
+	_timingReport(false)
 {
 	_data.resize(_x_cells * _y_cells * _t_cells * 2);
 	FILE* f = std::fopen("flow.raw", "rb");
@@ -35,13 +73,72 @@ FlowVis::FlowVis() :
 		fread(_data.data(), 1, _data.size() * sizeof(float), f);
 		fclose(f);
 	}
-	_identity_matrix = QMatrix();
+	_field = FlowField(_data.constData(), _x_cells, _y_cells, _t_cells);
+	_bounds.compute(_field);
 	_ortho_matrix = QMatrix();
+	_timerQueryPending[0] = _timerQueryPending[1] = false;
+	for (int i = 0; i < 2; i++) {
+		_checkpointPBO[i] = 0;
+		_checkpointPBOSize[i] = 0;
+		_checkpointFence[i] = 0;
+		_checkpointStep[i] = -1;
+	}
+	resetTiming();
 	_ortho_matrix.ortho(0.0f, _x_cells, 0.0f, _y_cells, 1.0f, -1.0f);
 }
 
+/* Deletes the OpenGL objects, so that the resource report at exit only
+ * lists objects that were lost along the way */
 FlowVis::~FlowVis()
 {
+#ifndef CG_HAVE_QVR
+	makeCurrent();
+#endif
+	// Without a context the objects are gone already or will go with the context
+	if (_vaoQuad == 0 || !QOpenGLContext::currentContext())
+		return;
+
+	_vertexArray.destroy();
+	_derived.clear();
+	_range.destroy();
+	for (int i = 0; i < 2; i++)
+		if (_checkpointFence[i])
+			glDeleteSync(_checkpointFence[i]);
+	if (_getQueryObjectui64v)
+		glDeleteQueries(2, _timerQueries);
+
+	// Objects that were never created are zero, which the deletion ignores
+	QVector<GLuint> textures = { _seedArray, _licTexture, _flowTexture, _transferFunction,
+		_noiseTexture, _ftleTexture };
+	for (int i = 0; i < 2; i++)
+		for (int k = 0; k < _maxTargets; k++)
+			textures.append(_meshTexture[i][k]);
+	QVector<GLuint> buffers = { _quadBuffers[0], _quadBuffers[1],
+		_checkpointPBO[0], _checkpointPBO[1] };
+	if (_vaoMesh != 0)
+		buffers << _meshBuffers[0] << _meshBuffers[1];
+	if (_vaoStatic != 0)
+		buffers << _staticBuffers[0] << _staticBuffers[1];
+	if (_vaoBaked != 0)
+		buffers << _bakedBuffers[0] << _bakedBuffers[1] << _bakedBuffers[2];
+	const QVector<GLuint> vertexArrays = { _vaoQuad, _vaoMesh, _vaoStatic, _vaoBaked };
+	const QVector<GLuint> framebuffers = { _meshFB[0], _meshFB[1], _noiseFB };
+
+	glDeleteTextures(textures.size(), textures.constData());
+	glDeleteBuffers(buffers.size(), buffers.constData());
+	glDeleteVertexArrays(vertexArrays.size(), vertexArrays.constData());
+	glDeleteFramebuffers(framebuffers.size(), framebuffers.constData());
+	for (GLuint texture : textures)
+		Cg::untrackResource(Cg::TextureResource, texture);
+	for (GLuint buffer : buffers)
+		Cg::untrackResource(Cg::BufferResource, buffer);
+	for (GLuint vertexArray : vertexArrays)
+		Cg::untrackResource(Cg::VertexArrayResource, vertexArray);
+	for (GLuint framebuffer : framebuffers)
+		Cg::untrackResource(Cg::FramebufferResource, framebuffer);
+#ifndef CG_HAVE_QVR
+	doneCurrent();
+#endif
 }
 
 void FlowVis::initializeGL()
@@ -67,88 +164,157 @@ void FlowVis::initializeGL()
 	const QVector<unsigned int> indices({
 			0, 1, 3, 1, 2, 3
 		});
-	_vertexArrayObject = Cg::createVertexArrayObject(positions, normals, texcoords, indices);
-	_indexCount = indices.size();
+	_vertexArray.create(positions, normals, texcoords, indices);
 	CG_ASSERT_GLCHECK();
 
-	// Set up geometry for a quad in NDC. Can be used to render into framebuffer color targets
-	const QVector<float> pos({
-			-1.0f, -1.0f, 0.0f,	1.0f, -1.0f, 0.0f,
-			1.0f, 1.0f, 0.0f,	-1.0f, 1.0f, 0.0f
-		});
-	const QVector<float> norm({
-			0.0f, 0.0f, 1.0f,   0.0f, 0.0f, 1.0f,
-			0.0f, 0.0f, 1.0f,   0.0f, 0.0f, 1.0f
-		});
-	const QVector<float> texco({
-			0.0f, 0.0f,   1.0f, 0.0f,
-			1.0f, 1.0f,   0.0f, 1.0f
+	// Set up geometry for a quad that covers the flow domain, in the vertex format
+	// of the mesh. Can be used to render into framebuffer color targets with _ortho_matrix
+	const QVector<MeshVertex> quad({
+			packVertex(QVector2D(0.0f, 0.0f), 0.0f, 0.0f),
+			packVertex(QVector2D(_x_cells, 0.0f), _x_cells, 0.0f),
+			packVertex(QVector2D(_x_cells, _y_cells), _x_cells, _y_cells),
+			packVertex(QVector2D(0.0f, _y_cells), 0.0f, _y_cells)
 		});
 	const QVector<unsigned int> indic({
 			0, 1, 3, 1, 2, 3
 		});
-	_vaoQuad = Cg::createVertexArrayObject(pos, norm, texco, indic);
+	glGenVertexArrays(1, &_vaoQuad);
+	glGenBuffers(2, _quadBuffers);
+	glBindVertexArray(_vaoQuad);
+	glBindBuffer(GL_ARRAY_BUFFER, _quadBuffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, quad.size() * sizeof(MeshVertex), quad.constData(), GL_STATIC_DRAW);
+	setMeshVertexFormat();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _quadBuffers[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indic.size() * sizeof(unsigned int), indic.constData(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	Cg::trackResource(Cg::VertexArrayResource, _vaoQuad);
+	Cg::trackResource(Cg::BufferResource, _quadBuffers[0], quad.size() * sizeof(MeshVertex));
+	Cg::trackResource(Cg::BufferResource, _quadBuffers[1], indic.size() * sizeof(unsigned int));
 	CG_ASSERT_GLCHECK();
 
-	// create a sparse noise texture that marks critical points
-	unsigned int texture;
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	CG_ASSERT_GLCHECK();
+	// Load the seed images to cycle through later
+	QVector<QImage> seedImages = Cg::loadTextureImages({
+			":/img/seeding_points", ":/img/whiteNoise", ":/img/whiteNoiseResized",
+			":/img/perlinNoise", ":/img/grid_biggest", ":/img/grid_big", ":/img/grid",
+			":/img/checkerBoard"
+		}, false);
 
-	QVector<float> vectorsRGBA;
-	QVector<float> rgba(4, 1.0f);	
+	// create a sparse noise image that marks critical points
+	QImage criticalPoints(_x_cells, _y_cells, QImage::Format_RGBA8888);
 	// initialize random seed
 	srand(time(NULL));
 
 	// loop over the data to mark critical points and insert random noise in green
+	const QVector<float>& magnitude = _derived.data(DerivedFields::Magnitude, _time_cell);
 	for (int y = 0; y < _y_cells; y++) {
+		uchar* rgba = criticalPoints.scanLine(y);
 		for (int x = 0; x < _x_cells; x++) {
-			float length = getFlowVector(_time_cell, y, x).length();
+			float length = magnitude[y * _x_cells + x];
 			// paint critical point in red
-			if (length <= 0.01)
-				rgba = { 1.0f, 0.0f, 0.0f, 1.0f };
-			else if (rand() % 60 < 1) {
-				rgba = { 0.0f, 1.0f, 0.0f, 1.0f };
-			} else
-				rgba = { 0.0f, 0.0f, 0.0f, 1.0f };
-			vectorsRGBA += rgba;
+			rgba[4 * x + 0] = (length <= 0.01 ? 255 : 0);
+			rgba[4 * x + 1] = (length > 0.01 && rand() % 60 < 1 ? 255 : 0);
+			rgba[4 * x + 2] = 0;
+			rgba[4 * x + 3] = 255;
 		}
 	}
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, _x_cells, _y_cells, 0, GL_RGBA, GL_FLOAT, vectorsRGBA.data());
-
-	// Load images into textures QVector to cycle through later
-	_texImages.append(Cg::loadTexture(":/img/seeding_points", false, false));
-	_texImages.append(texture);
-	_texImages.append(Cg::loadTexture(":/img/whiteNoise", false, false));
-	_texImages.append(Cg::loadTexture(":/img/whiteNoiseResized", false, false));
-	_texImages.append(Cg::loadTexture(":/img/perlinNoise", false, false));
-	_texImages.append(Cg::loadTexture(":/img/grid_biggest", false, false));
-	_texImages.append(Cg::loadTexture(":/img/grid_big", false, false));
-	_texImages.append(Cg::loadTexture(":/img/grid", false, false));
-	_texImages.append(Cg::loadTexture(":/img/checkerBoard", false, false));
-	_currentImage = _texImages[0];
+	// the critical points come second
+	seedImages.insert(1, criticalPoints);
+
+	// The seed images and the procedural noise are blended differently into
+	// the advected images
+	_seedBlend = QVector<GLenum>(seedImages.size(), GL_ONE_MINUS_SRC_ALPHA);
+	_seedBlend[0] = GL_DST_ALPHA;
+	_seedBlend[1] = GL_DST_ALPHA;
+	_seedLayer = 0;
+	createSeedArray(seedImages);
+	CG_ASSERT_GLCHECK();
+
+	// Noise images and output texture for Line Integral Convolution
+	_licNoise.append(QImage(":/img/whiteNoise"));
+	_licNoise.append(QImage(":/img/perlinNoise"));
+	glGenTextures(1, &_licTexture);
+	glBindTexture(GL_TEXTURE_2D, _licTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	// show the gray values in all color channels
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+	Cg::trackResource(Cg::TextureResource, _licTexture);
 	CG_ASSERT_GLCHECK();
 
 	// Set up the programmable pipeline
-	_prg.addShaderFromSourceCode(QOpenGLShader::Vertex,
-		Cg::prependGLSLVersion(Cg::loadFile(":vs.glsl")));
-	_prg.addShaderFromSourceCode(QOpenGLShader::Fragment,
-		Cg::prependGLSLVersion(Cg::loadFile(":fs.glsl")));
-	_prg.link();
+	Cg::buildProgram(_prg, ":vs.glsl", ":fs.glsl");
+	// the seed array gets a unit of its own, since samplers of different
+	// types must not share one
+	_prg.bind();
+	_prg.setUniformValue("seeds", 2);
 	CG_ASSERT_GLCHECK();
 
 	// Set up the programmable pipeline for the mesh shaders
-	_prgMesh.addShaderFromSourceCode(QOpenGLShader::Vertex,
-		Cg::prependGLSLVersion(Cg::loadFile(":vsMesh.glsl")));
-	_prgMesh.addShaderFromSourceCode(QOpenGLShader::Fragment,
-		Cg::prependGLSLVersion(Cg::loadFile(":fsMesh.glsl")));
-	_prgMesh.link();
+	linkMeshProgram(_prgMesh, ":fsMesh.glsl");
 	CG_ASSERT_GLCHECK();
 
+	// The programs for per-pixel advection, procedural noise and the range
+	// reduction are only needed once those are switched on; they are linked
+	// then, from binaries that are compiled in the background meanwhile
+	Cg::prepareProgramsInBackground({
+			qMakePair(QString(":vsMesh.glsl"), QString(":fsAdvect.glsl")),
+			qMakePair(QString(":vsMesh.glsl"), QString(":fsNoise.glsl")),
+			qMakePair(QString(":vsReduce.glsl"), QString(":fsReduce.glsl"))
+		});
+
+	// Flow vectors of the current time slice for the per-pixel advection
+	glGenTextures(1, &_flowTexture);
+	glBindTexture(GL_TEXTURE_2D, _flowTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, _x_cells, _y_cells, 0, GL_RG, GL_FLOAT, _field.slice(_time_cell));
+	Cg::trackResource(Cg::TextureResource, _flowTexture, Cg::textureBytes(GL_RG32F, _x_cells, _y_cells));
+	_flowTextureTime = _time_cell;
+	CG_ASSERT_GLCHECK();
+
+	// Transfer function for color-mapped magnitudes, a lookup table in a texture
+	// of height one. The control points approximate the viridis color map.
+	static const float controlPoints[][3] = {
+		{ 0.267f, 0.005f, 0.329f }, { 0.231f, 0.322f, 0.545f }, { 0.129f, 0.569f, 0.549f },
+		{ 0.369f, 0.788f, 0.384f }, { 0.992f, 0.906f, 0.145f }
+	};
+	const int controlPointCount = sizeof(controlPoints) / sizeof(controlPoints[0]);
+	QVector<unsigned char> transferFunction;
+	for (int i = 0; i < 256; i++) {
+		float t = i / 255.0f * (controlPointCount - 1);
+		int j = std::min(static_cast<int>(t), controlPointCount - 2);
+		float a = t - j;
+		for (int c = 0; c < 3; c++)
+			transferFunction.append(255.0f * ((1.0f - a) * controlPoints[j][c] + a * controlPoints[j + 1][c]) + 0.5f);
+		transferFunction.append(255);
+	}
+	glGenTextures(1, &_transferFunction);
+	glBindTexture(GL_TEXTURE_2D, _transferFunction);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 256, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, transferFunction.constData());
+	Cg::trackResource(Cg::TextureResource, _transferFunction, Cg::textureBytes(GL_RGBA8, 256, 1));
+	CG_ASSERT_GLCHECK();
+
+	// Timer queries to compare the cost of the advection methods. Their
+	// results are 64 bit, which QOpenGLExtraFunctions cannot read, so the
+	// function is resolved here; without it, only the CPU time is measured.
+	QOpenGLContext* context = QOpenGLContext::currentContext();
+	if (!context->isOpenGLES() && (context->format().version() >= qMakePair(3, 3)
+				|| context->hasExtension("GL_ARB_timer_query"))) {
+		_getQueryObjectui64v = reinterpret_cast<GetQueryObjectui64v>(
+			context->getProcAddress("glGetQueryObjectui64v"));
+	}
+	if (_getQueryObjectui64v)
+		glGenQueries(2, _timerQueries);
+
 	/*
 	-------- Add two framebuffers to render the mesh offscreen
 	*/
@@ -157,34 +323,36 @@ void FlowVis::initializeGL()
 	int buffer;
 	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &buffer);
 
-	// initial screen resolution
-	GLsizei SCR_WIDTH = _screenWidth;
-	GLsizei SCR_HEIGHT = _screenHeight;
-	// initialize two framebuffer objects
+	// a framebuffer for the procedural noise, at the advection resolution
+	glGenFramebuffers(1, &_noiseFB);
+	glGenTextures(1, &_noiseTexture);
+	glBindFramebuffer(GL_FRAMEBUFFER, _noiseFB);
+	glBindTexture(GL_TEXTURE_2D, _noiseTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _noiseTexture, 0);
+	Cg::trackResource(Cg::FramebufferResource, _noiseFB);
+
+	// initialize two framebuffer objects, with one color target per advected
+	// seed texture; the textures are created by fboTexResize()
 	glGenFramebuffers(2, _meshFB);
-	glGenTextures(2, _meshTexture);
+	Cg::trackResource(Cg::FramebufferResource, _meshFB[0]);
+	Cg::trackResource(Cg::FramebufferResource, _meshFB[1]);
+	for (int i = 0; i < 2; i++)
+		for (int k = 0; k < _maxTargets; k++)
+			_meshTexture[i][k] = 0;
+	_targetCount = 0;
+	fboTexResize(_advectionWidth, _advectionHeight, 1);
+
+	// - Finally check if framebuffers are complete
 	for (GLuint i = 0; i < 2; i++) {
 		glBindFramebuffer(GL_FRAMEBUFFER, _meshFB[i]);
-		glBindTexture(GL_TEXTURE_2D, _meshTexture[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		// attach texture to framebuffer
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _meshTexture[i], 0);
-
-		// - Finally check if framebuffer is complete
 		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 			std::cout << "Framebuffer not complete!" << std::endl;
 	}
-
-	/*
-	// Tell OpenGL which color attachment to use for rendering
-	//glDrawBuffer(GL_COLOR_ATTACHMENT0);
-	GLuint attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-	glDrawBuffers(2, attachments);
-	*/
+	glBindFramebuffer(GL_FRAMEBUFFER, _noiseFB);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "Framebuffer not complete!" << std::endl;
 
 	// rebind default framebuffer
 	glBindFramebuffer(GL_FRAMEBUFFER, buffer);
@@ -192,18 +360,33 @@ void FlowVis::initializeGL()
 
 QVector2D FlowVis::getFlowVector(int t, int y, int x)
 {
-	return QVector2D(
-		_data[2 * (t * _y_cells * _x_cells + y * _x_cells + x) + 0],
-		_data[2 * (t * _y_cells * _x_cells + y * _x_cells + x) + 1]);
+	return _field.at(t, y, x);
 }
 
 void FlowVis::paintGL(const QMatrix4x4& P, const QMatrix4x4& V, int w, int h)
 {
-	// Resize the textures of the FBOs if resolution changed
-	if (w != _screenWidth || h != _screenHeight) {
-		_screenWidth = w;
-		_screenHeight = h;
-		fboTexResize();
+	// Resize the textures of the FBOs once the wanted resolution has been
+	// stable for a while, so that dragging the window does not reallocate
+	// them on every intermediate size
+	QSize advectionSize = wantedAdvectionSize(w, h);
+	if (advectionSize == QSize(_advectionWidth, _advectionHeight)) {
+		// back at the current size, or resized already: nothing is pending
+		_pendingAdvectionSize = QSize();
+	} else if (advectionSize != _pendingAdvectionSize) {
+		_pendingAdvectionSize = advectionSize;
+		_resizeTimer.start();
+	} else if (_resizeTimer.elapsed() >= _resizeDelay) {
+		fboTexResize(advectionSize.width(), advectionSize.height(), _targetCount);
+		_pendingAdvectionSize = QSize();
+	}
+	// Add or remove the targets for the comparison seeds
+	int targetCount = _compareSeeds ? _maxTargets : 1;
+	if (targetCount != _targetCount)
+		fboTexResize(_advectionWidth, _advectionHeight, targetCount);
+
+	if (_posterRequested) {
+		_posterRequested = false;
+		renderPoster(_posterWidth, "poster.ppm");
 	}
 
 	Cg::OpenGLWidget::paintGL(P, V, w, h);
@@ -218,163 +401,724 @@ void FlowVis::paintGL(const QMatrix4x4& P, const QMatrix4x4& V, int w, int h)
 	int buffer;
 	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &buffer);
 
-	if (_first_iteration || _time_cell != _time_cell_in_texture) {
+	// Run as many advection steps as the playback speed asks for in this frame
+	int steps = 0;
+	if (_time_is_passing) {
+		_substepBudget += _substepsPerFrame;
+		steps = static_cast<int>(_substepBudget);
+		_substepBudget -= steps;
+	}
+	if (_licMode == 0) {
+		if (!_first_iteration && _seekStep >= 0) {
+			seek(_seekStep);
+		} else if (!_first_iteration && _reversePlayback) {
+			if (steps > 0)
+				seek(std::max(_step - steps, 0));
+		} else {
+			advect(steps);
+		}
+		_seekStep = -1;
+	} else {
+		for (int i = 0; i < steps; i++)
+			_time_cell = (_time_cell + 1) % _t_cells;
+	}
+
+	// rebind default framebuffer
+	glBindFramebuffer(GL_FRAMEBUFFER, buffer);
+	glViewport(0, 0, w, h);
+	glDisable(GL_BLEND);
+
+	// Render: draw triangles with a texture
+	_prg.bind();
+	_prg.setUniformValue("projection_matrix", P);
+	_prg.setUniformValue("field_mode", 0);
+	_prg.setUniformValue("tex", 0);
+
+	// first window (top) to see mesh method; the advected comparison seeds
+	// share it with the current one as tiles, two per row
+	if (_licMode > 0) {
+		QMatrix4x4 modViewMesh = V;
+		modViewMesh.translate(0.0f, 0.5f, 0.0f);
+		_prg.setUniformValue("modelview_matrix", modViewMesh);
+		updateLIC(w, h);
+		glBindTexture(GL_TEXTURE_2D, _licTexture);
+		_vertexArray.draw();
+	} else {
+		int columns = _targetCount > 1 ? 2 : 1;
+		float scale = 1.0f / columns;
+		for (int k = 0; k < _targetCount; k++) {
+			float x = _x_start + (k % columns) * (_x_end - _x_start) * scale;
+			float y = _y_start + (k / columns) * (_y_end - _y_start) * scale;
+			QMatrix4x4 modViewMesh = V;
+			modViewMesh.translate(x - scale * _x_start, 0.5f + y - scale * _y_start, 0.0f);
+			modViewMesh.scale(scale, scale, 1.0f);
+			_prg.setUniformValue("modelview_matrix", modViewMesh);
+			glBindTexture(GL_TEXTURE_2D, _meshTexture[!_meshIteration][k]);
+			_vertexArray.draw();
+		}
+	}
+
+	// a window (bottom) to show default texture used for texture advection,
+	// or a derived quantity of the current time slice
+	QMatrix4x4 modviewMatrix = V;
+	modviewMatrix.translate(0.0f, -0.6f, 0.0f);
+	_prg.setUniformValue("modelview_matrix", modviewMatrix);
+	if (_fieldView == _colorMapView) {
+		// magnitude through the transfer function, with the range computed on
+		// the GPU; until the first range arrives, use the one from the CPU
+		updateFlowTexture();
+		_range.reduce(_flowTexture, _x_cells, _y_cells);
+		float minValue, maxValue;
+		if (!_range.range(&minValue, &maxValue))
+			_derived.range(DerivedFields::Magnitude, _time_cell, &minValue, &maxValue);
+		_prg.setUniformValue("field_mode", 3);
+		_prg.setUniformValue("min_length", minValue);
+		_prg.setUniformValue("max_length", maxValue);
+		_prg.setUniformValue("transfer_function", 1);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, _transferFunction);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, _flowTexture);
+	} else if (_fieldView == _ftleView) {
+		updateFTLE();
+		_prg.setUniformValue("field_mode", 1);
+		_prg.setUniformValue("max_length", std::max(_ftleMax, 1e-6f));
+		glBindTexture(GL_TEXTURE_2D, _ftleTexture);
+	} else if (_fieldView > 0) {
+		DerivedFields::Quantity q = static_cast<DerivedFields::Quantity>(_fieldView - 1);
+		float minValue, maxValue;
+		_derived.range(q, _time_cell, &minValue, &maxValue);
+		bool isSigned = (q != DerivedFields::Magnitude);
+		_prg.setUniformValue("field_mode", isSigned ? 2 : 1);
+		_prg.setUniformValue("max_length", isSigned ? std::max(-minValue, maxValue) : maxValue);
+		glBindTexture(GL_TEXTURE_2D, _derived.texture(q, _time_cell));
+	} else if (_noiseType > 0) {
+		glBindTexture(GL_TEXTURE_2D, _noiseTexture);
+	} else {
+		_prg.setUniformValue("field_mode", 4);
+		_prg.setUniformValue("seed_layer", _seedLayer);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, _seedArray);
+		glActiveTexture(GL_TEXTURE0);
+	}
+	// draw the two triangles of the panel
+	_vertexArray.draw();
+	CG_ASSERT_GLCHECK();
+
+}
+
+/* Runs the given number of advection steps into the offscreen framebuffers
+ * and advances the time by one cell after each. After a restart, at least
+ * one step is done even if the time does not pass. All state that does not
+ * change between steps is set up only once. */
+void FlowVis::advect(int steps) {
+	fetchCheckpoints();
+	int passes = std::max(steps, _first_iteration ? 1 : 0);
+	if (passes == 0)
+		return;
+
+	// Collect the GPU time of the previous frame's query, if it is ready
+	GLuint previousQuery = _timerQueries[!_timerQuery];
+	if (_timerQueryPending[!_timerQuery]) {
+		GLuint available = 0;
+		glGetQueryObjectuiv(previousQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 nanoseconds;
+			_getQueryObjectui64v(previousQuery, GL_QUERY_RESULT, &nanoseconds);
+			_timingGPU += nanoseconds / 1e6;
+			_timingGPUSteps += _timerQuerySteps[!_timerQuery];
+		}
+		_timerQueryPending[!_timerQuery] = false;
+	}
+	QElapsedTimer cpuTimer;
+	cpuTimer.start();
+	if (_getQueryObjectui64v)
+		glBeginQuery(GL_TIME_ELAPSED, _timerQueries[_timerQuery]);
+
+	// Each target reads its own texture unit
+	static const GLint textureUnits[_maxTargets] = { 0, 1, 2, 3 };
+	static const GLenum attachments[_maxTargets] = {
+		GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3
+	};
+	// Targets read their seed from the seed array, or from the texture of
+	// their unit where the layer is -1
+	static const GLint noSeeds[_maxTargets] = { -1, -1, -1, -1 };
+	QVector<GLint> seeds = seedLayers();
+	const int seedUnit = _maxTargets + 1;
+	glActiveTexture(GL_TEXTURE0 + seedUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, _seedArray);
+	// While a poster is rendered, the textures of the targets and the noise
+	// only hold the current tile, but the texture coordinates span the domain
+	QVector4D tileRect(0.0f, 0.0f, 1.0f, 1.0f);
+	if (_posterSize.isValid()) {
+		tileRect = QVector4D(float(_posterTile.x()) / _posterSize.width(),
+			float(_posterTile.y()) / _posterSize.height(),
+			float(_posterSize.width()) / _posterTile.width(),
+			float(_posterSize.height()) / _posterTile.height());
+	}
+
+	if (_pixelAdvection) {
+		linkMeshProgram(_prgAdvect, ":fsAdvect.glsl");
+		_prgAdvect.bind();
+		_prgAdvect.setUniformValueArray("tex", textureUnits, _maxTargets);
+		_prgAdvect.setUniformValue("seeds", seedUnit);
+		_prgAdvect.setUniformValue("tile_rect", tileRect);
+		_prgAdvect.setUniformValue("flow", _maxTargets);
+		_prgAdvect.setUniformValue("target_count", _targetCount);
+		_prgAdvect.setUniformValue("cells", QVector2D(_x_cells, _y_cells));
+		_prgAdvect.setUniformValue("step_size", _stepSize);
+		_prgAdvect.setUniformValue("alpha", 1.0f);
+		_prgAdvect.setUniformValue("projection_matrix", _ortho_matrix);
+	}
+	// bind the program (linked shaders) to render off screen
+	glViewport(0, 0, _advectionWidth, _advectionHeight);
+	_prgMesh.bind();
+	_prgMesh.setUniformValueArray("tex", textureUnits, _maxTargets);
+	_prgMesh.setUniformValue("seeds", seedUnit);
+	_prgMesh.setUniformValue("tile_rect", tileRect);
+	_prgMesh.setUniformValue("target_count", _targetCount);
+	_prgMesh.setUniformValue("projection_matrix", _ortho_matrix);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	// the mesh is drawn with an opaque alpha over a black background, so the
+	// blend function only matters for the seed quads
+	if (_blendOn)
+		glEnable(GL_BLEND);
+	else
+		glDisable(GL_BLEND);
+
+	for (int i = 0; i < passes; i++) {
+		// the procedural noise changes with every step
+		if (_noiseType > 0) {
+			renderNoise();
+			_prgMesh.bind();
+		}
+
 		// bind offscreen framebuffers for the mesh
 		glBindFramebuffer(GL_FRAMEBUFFER, _meshFB[_meshIteration]);
-		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		// bind the program (linked shaders) to render off screen
-		_prgMesh.bind();
-		_prgMesh.setUniformValue("tex", 0);
-		createMesh();
 		_time_cell_in_texture = _time_cell;
 
-		if (_blendOn) {
-			glEnable(GL_BLEND);
-			// use different blending for seeding textures
-			if (_currentImage <= _texImages[0])
-				glBlendFunc(GL_SRC_ALPHA, GL_DST_ALPHA);
-			else 
-				glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		// Read either the seeds or the previous results, one per target
+		const GLint* layers = _first_iteration ? seeds.constData() : noSeeds;
+		for (int k = 0; k < _targetCount; k++) {
+			glActiveTexture(GL_TEXTURE0 + k);
+			glBindTexture(GL_TEXTURE_2D, _first_iteration ? _noiseTexture : _meshTexture[!_meshIteration][k]);
 		}
-		else {
-			glDisable(GL_BLEND);
+		_prgMesh.setUniformValueArray("seed_layer", layers, _maxTargets);
+
+		if (_pixelAdvection) {
+			// Trace each pixel backwards through the flow and fetch from there
+			updateFlowTexture();
+			_prgAdvect.bind();
+			_prgAdvect.setUniformValueArray("seed_layer", layers, _maxTargets);
+			glActiveTexture(GL_TEXTURE0 + _maxTargets);
+			glBindTexture(GL_TEXTURE_2D, _flowTexture);
+			glBindVertexArray(_vaoQuad);
+			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+			_prgMesh.bind();
+		} else if (_useBake && !_adaptiveMesh && !_posterSize.isValid() && (_bake.matches(_nMesh, _stepSize) || prepareBake())) {
+			// Draw the precomputed mesh of this time cell into all targets at once
+			glBindVertexArray(_vaoBaked);
+			glBindBuffer(GL_ARRAY_BUFFER, _bakedBuffers[0]);
+			glBufferData(GL_ARRAY_BUFFER, _bake.vertexCount() * 2 * sizeof(quint16),
+				_bake.positions(_time_cell), GL_STREAM_DRAW);
+			Cg::trackResource(Cg::BufferResource, _bakedBuffers[0], _bake.vertexCount() * 2 * sizeof(quint16));
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			_prgMesh.setUniformValue("alpha", 1.0f);
+			glDrawElements(GL_TRIANGLES, _indexCountBaked, GL_UNSIGNED_INT, 0);
+		} else {
+			// Draw distorted mesh into all targets at once
+			createMesh();
+			_prgMesh.setUniformValue("alpha", 1.0f);
+			glBindVertexArray(_vaoMesh);
+			glDrawElements(GL_TRIANGLES, _indexCountMesh, GL_UNSIGNED_INT, 0);
+			// Draw the quads that do not move from the prebuilt undistorted mesh
+			if (!_staticCounts.isEmpty()) {
+				glBindVertexArray(_vaoStatic);
+				for (int k = 0; k < _staticCounts.size(); k++)
+					glDrawElements(GL_TRIANGLES, _staticCounts[k], GL_UNSIGNED_INT,
+						reinterpret_cast<const void*>(_staticFirsts[k] * sizeof(unsigned int)));
+			}
 		}
-
-		// Draw distorted mesh with either the current image or the previous result
-		_prgMesh.setUniformValue("alpha", 1.0f);
-		_prgMesh.setUniformValue("projection_matrix", _ortho_matrix);
-		glBindVertexArray(_vaoMesh);
-		glBindTexture(GL_TEXTURE_2D, _first_iteration ? _currentImage : _meshTexture[!_meshIteration]);
-		glDrawElements(GL_TRIANGLES, _indexCountMesh, GL_UNSIGNED_INT, 0);
 		CG_ASSERT_GLCHECK();
 
 		if (_blendOn) {
-			// Draw initial texture into a quad (NDC) for blending
+			// Draw the seeds into a quad covering the domain for blending.
+			// Each target gets its own draw, because the blending depends on the seed.
 			_prgMesh.setUniformValue("alpha", 0.1f);
-			_prgMesh.setUniformValue("projection_matrix", _identity_matrix);
+			_prgMesh.setUniformValueArray("seed_layer", seeds.constData(), _maxTargets);
 			glBindVertexArray(_vaoQuad);
-			glBindTexture(GL_TEXTURE_2D, _currentImage);
-			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, _noiseTexture);
+			for (int k = 0; k < _targetCount; k++) {
+				glBlendFunc(GL_SRC_ALPHA, seeds[k] >= 0 ? _seedBlend[seeds[k]] : GL_ONE_MINUS_SRC_ALPHA);
+				GLenum selected[_maxTargets] = { GL_NONE, GL_NONE, GL_NONE, GL_NONE };
+				selected[k] = attachments[k];
+				glDrawBuffers(_targetCount, selected);
+				glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+			}
+			glDrawBuffers(_targetCount, attachments);
 			CG_ASSERT_GLCHECK();
 		}
+		glActiveTexture(GL_TEXTURE0);
 
 		_meshIteration = !_meshIteration;
-		if (_first_iteration)
+		if (_first_iteration) {
+			// a restart invalidates the checkpoints of the previous run
 			_first_iteration = false;
+			clearCheckpoints();
+			_step = 0;
+		} else {
+			_step++;
+		}
+		// Update to animate, turned on/off with Key_T
+		if (i < steps)
+			_time_cell = (_time_cell + 1) % _t_cells;
+		if (_step % _checkpointInterval == 0 && !_checkpoints.contains(_step) && !_posterSize.isValid())
+			saveCheckpoint();
 	}
 
-	// rebind default framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, buffer);
-	glDisable(GL_BLEND);
+	if (_getQueryObjectui64v) {
+		glEndQuery(GL_TIME_ELAPSED);
+		_timerQueryPending[_timerQuery] = true;
+		_timerQuerySteps[_timerQuery] = passes;
+		_timerQuery = !_timerQuery;
+	}
+	_timingCPU += cpuTimer.nsecsElapsed() / 1e6;
+	_timingSteps += passes;
+	_timingFrames++;
+	if (_timingFrames == 100 && _timingReport) {
+		std::cout << (_pixelAdvection ? "per-pixel" : "mesh") << " advection: "
+			<< _timingCPU / _timingSteps << " ms CPU per step";
+		if (_getQueryObjectui64v)
+			std::cout << ", " << _timingGPU / std::max(_timingGPUSteps, 1) << " ms GPU per step";
+		std::cout << std::endl;
+	}
+	if (_timingFrames == 100)
+		resetTiming();
+}
 
-	// Render: draw triangles with a texture
-	_prg.bind();
-	_prg.setUniformValue("projection_matrix", P);
-	_prg.setUniformValue("max_length", 1.5f); // just a guess
-	_prg.setUniformValue("tex", 0); // just a guess
-	// bind the vao that has two triangles
-	glBindVertexArray(_vertexArrayObject);
-
-	// first window (top) to see mesh method
-	QMatrix4x4 modViewMesh = V;
-	modViewMesh.translate(0.0f, 0.5f, 0.0f);
-	_prg.setUniformValue("modelview_matrix", modViewMesh);
-	glBindTexture(GL_TEXTURE_2D, _meshTexture[!_meshIteration]);
-	glDrawElements(GL_TRIANGLES, _indexCount, GL_UNSIGNED_INT, 0);
-
-	// a window (bottom) to show default texture used for texture advection
-	QMatrix4x4 modviewMatrix = V;
-	modviewMatrix.translate(0.0f, -0.6f, 0.0f);
-	_prg.setUniformValue("modelview_matrix", modviewMatrix);
-	glBindTexture(GL_TEXTURE_2D, _currentImage);
-	glDrawElements(GL_TRIANGLES, _indexCount, GL_UNSIGNED_INT, 0);
-	CG_ASSERT_GLCHECK();
+/* Restarts the measurement of the advection cost */
+void FlowVis::resetTiming() {
+	_timingCPU = 0.0;
+	_timingGPU = 0.0;
+	_timingSteps = 0;
+	_timingFrames = 0;
+	_timingGPUSteps = 0;
+}
 
-	// Update to animate, turned on/off with Key_T
-	if (_time_is_passing) {
-		_time_cell++;
-		if (_time_cell >= _t_cells)
-			_time_cell = 0;
+/* Returns the seeds of all advection targets as layers of the seed array:
+ * the current seed first, then the images it is compared with. The
+ * procedural noise and unused targets are -1. */
+QVector<GLint> FlowVis::seedLayers() const {
+	// perlinNoise, grid and checkerBoard
+	static const int comparison[_maxTargets - 1] = { 4, 7, 8 };
+	QVector<GLint> layers(_maxTargets, -1);
+	layers[0] = _noiseType > 0 ? -1 : _seedLayer;
+	for (int k = 1; k < _targetCount; k++)
+		layers[k] = comparison[k - 1];
+	return layers;
+}
+
+/* Resamples the seed images to a common size, the largest width and height
+ * among them, and uploads them into the layers of one array texture */
+void FlowVis::createSeedArray(QVector<QImage> images) {
+	int width = 0;
+	int height = 0;
+	for (int i = 0; i < images.size(); i++) {
+		width = std::max(width, images[i].width());
+		height = std::max(height, images[i].height());
 	}
+	QImage* image = images.data();
+	Cg::parallelFor(images.size(), [&](int begin, int end) {
+		for (int i = begin; i < end; i++)
+			if (image[i].size() != QSize(width, height))
+				image[i] = image[i].scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+					.convertToFormat(QImage::Format_RGBA8888);
+	});
+
+	glGenTextures(1, &_seedArray);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, _seedArray);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, images.size(), 0,
+		GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	for (int i = 0; i < images.size(); i++)
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, width, height, 1,
+			GL_RGBA, GL_UNSIGNED_BYTE, images[i].constBits());
+	Cg::trackResource(Cg::TextureResource, _seedArray,
+		images.size() * Cg::textureBytes(GL_RGBA8, width, height));
+	_seedLayers = images.size();
+}
+
+/* Renders the procedural noise of the current time into its framebuffer.
+ * The noise is periodic over _noisePeriod time cells. */
+void FlowVis::renderNoise() {
+	// feature sizes in pixels for white, Perlin and spot noise
+	static const float scales[] = { 2.0f, 16.0f, 12.0f };
+
+	glBindFramebuffer(GL_FRAMEBUFFER, _noiseFB);
+	glDisable(GL_BLEND);
+	linkMeshProgram(_prgNoise, ":fsNoise.glsl");
+	_prgNoise.bind();
+	_prgNoise.setUniformValue("projection_matrix", _ortho_matrix);
+	// a poster is rendered in tiles, but the noise must not depend on them
+	if (_posterSize.isValid())
+		_prgNoise.setUniformValue("resolution", QVector2D(_posterSize.width(), _posterSize.height()));
+	else
+		_prgNoise.setUniformValue("resolution", QVector2D(_advectionWidth, _advectionHeight));
+	_prgNoise.setUniformValue("scale", scales[_noiseType - 1]);
+	_prgNoise.setUniformValue("time", float(_time_cell % _noisePeriod) / _noisePeriod);
+	// an unsigned uniform, which QOpenGLShaderProgram would set with glUniform1i
+	glUniform1ui(_prgNoise.uniformLocation("seed"), _noiseSeed);
+	_prgNoise.setUniformValue("noise_type", _noiseType);
+	glBindVertexArray(_vaoQuad);
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	if (_blendOn)
+		glEnable(GL_BLEND);
+	CG_ASSERT_GLCHECK();
+}
+
+/* Uploads the flow vectors of the current time slice, if they are not there yet */
+void FlowVis::updateFlowTexture() {
+	if (_flowTextureTime == _time_cell)
+		return;
+	glBindTexture(GL_TEXTURE_2D, _flowTexture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _x_cells, _y_cells, GL_RG, GL_FLOAT, _field.slice(_time_cell));
+	_flowTextureTime = _time_cell;
+}
+
+/* Maps a value in [0, 1] to a 16-bit normalized integer, with the given
+ * margin of integers on each side for values outside, clamping the rest.
+ * Sets clamped if the value had to be clamped. */
+static quint16 quantize(float value, int margin = 0, bool* clamped = nullptr) {
+	float packed = std::round(margin + value * (65535 - 2 * margin));
+	if (clamped && (packed < 0.0f || packed > 65535.0f))
+		*clamped = true;
+	return std::min(std::max(packed, 0.0f), 65535.0f);
 }
 
-/* Transforms a [0, dimLength] input into tex coords between 0.0 and 1.0 */
-float texTF(float input, float dimLength) {
-	return input / dimLength;
+// Set once the first mesh vertex was clamped; meshes are also built in parallel
+static QAtomicInt clampReported;
+
+/* Packs an advected mesh vertex. The texture coordinates are those of the
+ * undistorted position (x, y). Positions beyond the margin are clamped,
+ * which distorts the quads at the border, so the first one is reported. */
+FlowVis::MeshVertex FlowVis::packVertex(QVector2D position, float x, float y) const {
+	MeshVertex v;
+	bool clamped = false;
+	v.x = quantize(position.x() / _x_cells, _meshMargin, &clamped);
+	v.y = quantize(position.y() / _y_cells, _meshMargin, &clamped);
+	v.s = quantize(x / _x_cells);
+	v.t = quantize(y / _y_cells);
+	if (clamped && clampReported.testAndSetRelaxed(0, 1))
+		std::cout << "mesh vertex at (" << position.x() << ", " << position.y()
+			<< ") is beyond the margin of the packed positions and clamped" << std::endl;
+	return v;
+}
+
+void FlowVis::appendVertex(QVector<MeshVertex>& vertices, QVector2D position, float x, float y) const {
+	vertices.append(packVertex(position, x, y));
+}
+
+/* Stores the values that packVertex() rounds, so that the same uniforms
+ * unpack them, and nothing is clamped */
+void FlowVis::appendVertex(QVector<PosterVertex>& vertices, QVector2D position, float x, float y) const {
+	float range = 65535 - 2 * _meshMargin;
+	PosterVertex v;
+	v.x = (_meshMargin + position.x() / _x_cells * range) / 65535.0f;
+	v.y = (_meshMargin + position.y() / _y_cells * range) / 65535.0f;
+	v.s = x / _x_cells;
+	v.t = y / _y_cells;
+	vertices.append(v);
+}
+
+/* Sets up the attributes of the bound vertex array for mesh vertices in the
+ * bound array buffer */
+void FlowVis::setMeshVertexFormat() {
+	glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(MeshVertex),
+		reinterpret_cast<const void*>(offsetof(MeshVertex, x)));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(MeshVertex),
+		reinterpret_cast<const void*>(offsetof(MeshVertex, s)));
+	glEnableVertexAttribArray(2);
+}
+
+/* Same as above for poster vertices */
+void FlowVis::setPosterVertexFormat() {
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(PosterVertex),
+		reinterpret_cast<const void*>(offsetof(PosterVertex, x)));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(PosterVertex),
+		reinterpret_cast<const void*>(offsetof(PosterVertex, s)));
+	glEnableVertexAttribArray(2);
+}
+
+/* Sets the uniforms with which vsMesh.glsl unpacks mesh vertices */
+void FlowVis::setMeshVertexUniforms(QOpenGLShaderProgram& prg) {
+	float range = 65535.0f / (65535 - 2 * _meshMargin);
+	float margin = _meshMargin / float(65535 - 2 * _meshMargin);
+	prg.bind();
+	prg.setUniformValue("position_scale", QVector2D(range * _x_cells, range * _y_cells));
+	prg.setUniformValue("position_offset", QVector2D(-margin * _x_cells, -margin * _y_cells));
+}
+
+/* Links a program that draws mesh vertices with vsMesh.glsl, unless it is
+ * linked already */
+void FlowVis::linkMeshProgram(QOpenGLShaderProgram& prg, const QString& fragmentShaderFile) {
+	if (prg.isLinked())
+		return;
+	Cg::buildProgram(prg, ":vsMesh.glsl", fragmentShaderFile);
+	setMeshVertexUniforms(prg);
 }
 
 /* Bilinearly interpolates coordinates before getting the flow vector */
 QVector2D FlowVis::getFlowVector(float x, float y, float t) {
-	int ct = round(t);
-	ct = std::min(std::max(ct, 0), _t_cells - 1);
-
-	// Biliniear Interpolation in 2D as it is described in the SciVis script part 02 page 20
-	int x00 = floor(x);
-	x00 = std::min(std::max(x00, 0), _x_cells - 1);
-	int x10 = ceil(x);
-	x10 = std::min(std::max(x10, 0), _x_cells - 1);
-	int y00 = floor(y);
-	y00 = std::min(std::max(y00, 0), _y_cells - 1);
-	int y01 = ceil(y);
-	y01 = std::min(std::max(y01, 0), _y_cells - 1);
-	QVector2D f00 = getFlowVector(ct, y00, x00);
-	QVector2D f10 = getFlowVector(ct, y00, x10);
-	QVector2D f01 = getFlowVector(ct, y01, x00);
-	QVector2D f11 = getFlowVector(ct, y01, x10);
-	float alpha = 0.0f;
-	if (x10 - x00 != 0)
-		alpha = (x - x00) / (x10 - x00);
-	QVector2D f0 = alpha * f10 + (1 - alpha) * f00;
-	QVector2D f1 = alpha * f11 + (1 - alpha) * f01;
-
-	float beta = 0.0f;
-	if (y01 - y00 != 0)
-		beta = (y - y00) / (y01 - y00);
-	QVector2D f = beta * f1 + (1 - beta) * f0;
-
-	return f;	
-	
-	/*
-	// Nearest Neighbour
-	int cx = round(x);
-	int cy = round(y);
-	cx = std::min(std::max(cx, 0), _x_cells - 1);
-	cy = std::min(std::max(cy, 0), _y_cells - 1);
-
-	return getFlowVector(t, cy, cx);
-	*/
+	return _field.sample(x, y, t);
 }
 
 /* Use Heun integration to better approximate flow vectors */
 QVector2D FlowVis::heun(float stepSize, QVector2D position) {
-	float timeCell = _time_cell;
-	QVector2D result;
-	QVector2D speed = getFlowVector(position.x(), position.y(), timeCell);
+	return _field.heun(stepSize, position, _time_cell);
+}
+
+/* Creates the mesh for the current time cell and uploads it. Quads that
+ * move less than a fraction of a pixel are left out and collected as index
+ * ranges into the static mesh instead. Posters get an unpacked mesh without
+ * static quads, because the rounding of packed positions would add up over
+ * the poster steps. */
+void FlowVis::createMesh() {
+	bool poster = _posterSize.isValid();
+	QVector<bool> staticQuads;
+	if (_cullStatic && !_adaptiveMesh && !poster)
+		staticQuads = findStaticQuads(_time_cell);
+	QVector<MeshVertex> vertices;
+	QVector<PosterVertex> posterVertices;
+	QVector<unsigned int> indices;
+	if (poster)
+		buildMesh(_time_cell, _nMesh, _stepSize, _adaptiveMesh, posterVertices, indices);
+	else
+		buildMesh(_time_cell, _nMesh, _stepSize, _adaptiveMesh, vertices, indices, staticQuads);
+
+	// Consecutive static quads are drawn with one call
+	_staticCounts.clear();
+	_staticFirsts.clear();
+	for (int q = 0; q < staticQuads.size(); q++) {
+		if (!staticQuads[q])
+			continue;
+		if (q > 0 && staticQuads[q - 1]) {
+			_staticCounts.last() += 6;
+		} else {
+			_staticCounts.append(6);
+			_staticFirsts.append(6 * q);
+		}
+	}
+	if (!_staticCounts.isEmpty() && _staticMeshSize != _nMesh)
+		createStaticMesh();
+
+	// Reuse the vertex array and its buffers; only their contents and the
+	// vertex format change
+	if (_vaoMesh == 0) {
+		glGenVertexArrays(1, &_vaoMesh);
+		glGenBuffers(2, _meshBuffers);
+	}
+	glBindVertexArray(_vaoMesh);
+	glBindBuffer(GL_ARRAY_BUFFER, _meshBuffers[0]);
+	qint64 vertexBytes;
+	if (poster) {
+		vertexBytes = posterVertices.size() * sizeof(PosterVertex);
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes, posterVertices.constData(), GL_STREAM_DRAW);
+		setPosterVertexFormat();
+	} else {
+		vertexBytes = vertices.size() * sizeof(MeshVertex);
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices.constData(), GL_STREAM_DRAW);
+		setMeshVertexFormat();
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _meshBuffers[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.constData(), GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	Cg::trackResource(Cg::VertexArrayResource, _vaoMesh);
+	Cg::trackResource(Cg::BufferResource, _meshBuffers[0], vertexBytes);
+	Cg::trackResource(Cg::BufferResource, _meshBuffers[1], indices.size() * sizeof(unsigned int));
+	_indexCountMesh = indices.size();
+}
 
-	result = position + stepSize * getFlowVector(position.x(), position.y(), timeCell);
-	QVector2D speedNext = getFlowVector(result.x(), result.y(), timeCell + stepSize);
+/* Marks the quads of the uniform mesh in the order of buildMesh() that move
+ * less than _staticThreshold pixels in time cell t, going by the velocity
+ * bounds of the tiles around them. A margin of one cell covers the bilinear
+ * interpolation and the second sample of the Heun step. */
+QVector<bool> FlowVis::findStaticQuads(int t) const {
+	float width = _x_cells;
+	float height = _y_cells;
+	int NMESH_Y = _nMesh;
+	float DIST = height / NMESH_Y;
+	int NMESH_X = width / DIST;
+	float offset = 0.1f;
 
-	result = position + (stepSize * 0.5 * (speed + speedNext));
+	// the orthographic projection maps the domain to the advection framebuffer
+	float pixelsPerCell = 0.5f * std::max(std::abs(_ortho_matrix(0, 0)) * _advectionWidth,
+		std::abs(_ortho_matrix(1, 1)) * _advectionHeight);
+	float maxSpeed = _staticThreshold / (pixelsPerCell * _stepSize);
+	int t1 = t + int(std::ceil(_stepSize));
 
-	return result;
+	QVector<bool> staticQuads(NMESH_X * NMESH_Y);
+	for (int i = 0; i < NMESH_X; i++) {
+		float x1 = DIST * i + offset;
+		for (int j = 0; j < NMESH_Y; j++) {
+			float y1 = DIST * j;
+			staticQuads[i * NMESH_Y + j] =
+				_bounds.maxSpeed(t, t1, x1 - 1.0f, y1 - 1.0f, x1 + DIST + 1.0f, y1 + DIST + 1.0f) < maxSpeed;
+		}
+	}
+	return staticQuads;
 }
 
-/* Creates a mesh and distorts it in the direction of the flow */
-void FlowVis::createMesh() {
+/* Creates the undistorted uniform mesh without the border, in the order of
+ * buildMesh(), so that the index ranges of static quads are the same */
+void FlowVis::createStaticMesh() {
 	float width = _x_cells;
 	float height = _y_cells;
 	int NMESH_Y = _nMesh;
 	float DIST = height / NMESH_Y;
 	int NMESH_X = width / DIST;
+	float offset = 0.1f;
 
-	QVector<float> positions, normals, texcoords;
+	QVector<MeshVertex> vertices;
 	QVector<unsigned int> indices;
-	_indexCountMesh = 0;
-	QVector3D pos;
+	unsigned int vertexCount = 0;
+	for (int i = 0; i < NMESH_X; i++) {
+		float x1 = DIST * i + offset;
+		float x2 = x1 + DIST;
+		for (int j = 0; j < NMESH_Y; j++) {
+			float y1 = DIST * j;
+			float y2 = y1 + DIST;
+			vertices.append(packVertex(QVector2D(x1, y2), x1, y2));
+			vertices.append(packVertex(QVector2D(x2, y2), x2, y2));
+			vertices.append(packVertex(QVector2D(x2, y1), x2, y1));
+			vertices.append(packVertex(QVector2D(x1, y1), x1, y1));
+			indices.append({ vertexCount, vertexCount + 1, vertexCount + 3, vertexCount + 1, vertexCount + 2, vertexCount + 3 });
+			vertexCount += 4;
+		}
+	}
+
+	if (_vaoStatic == 0) {
+		glGenVertexArrays(1, &_vaoStatic);
+		glGenBuffers(2, _staticBuffers);
+		glBindVertexArray(_vaoStatic);
+		glBindBuffer(GL_ARRAY_BUFFER, _staticBuffers[0]);
+		setMeshVertexFormat();
+	}
+	glBindVertexArray(_vaoStatic);
+	glBindBuffer(GL_ARRAY_BUFFER, _staticBuffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex), vertices.constData(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _staticBuffers[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.constData(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	Cg::trackResource(Cg::VertexArrayResource, _vaoStatic);
+	Cg::trackResource(Cg::BufferResource, _staticBuffers[0], vertices.size() * sizeof(MeshVertex));
+	Cg::trackResource(Cg::BufferResource, _staticBuffers[1], indices.size() * sizeof(unsigned int));
+	_staticMeshSize = _nMesh;
+	CG_ASSERT_GLCHECK();
+}
+
+/* Opens the mesh cache for the current mesh parameters and sets up the parts
+ * of the baked mesh that do not change over time. If there is no cache, it
+ * is baked in a background thread, and the caller draws the live mesh until
+ * it is done. Returns false while the cache is not open. */
+bool FlowVis::prepareBake() {
+	bool ok;
+	if (_bake.finishBake(&ok) && !ok) {
+		std::cout << "cannot write the mesh cache" << std::endl;
+		_useBake = false;
+		return false;
+	}
+	if (_bake.isBaking())
+		return false;
+
+	QVector<MeshVertex> vertices;
+	QVector<unsigned int> indices;
+	buildMesh(0, _nMesh, _stepSize, false, vertices, indices);
+	int vertexCount = vertices.size();
+
+	QString fileName = MeshBake::fileName(_nMesh, _stepSize);
+	if (!_bake.open(fileName, _filename, _x_cells, _y_cells, _t_cells, _nMesh, _stepSize)) {
+		std::cout << "baking " << fileName.toStdString() << std::endl;
+		// the thread uses its own copy of the mesh parameters, which may change meanwhile
+		int nMesh = _nMesh;
+		float stepSize = _stepSize;
+		_bake.bake(fileName, _filename, _x_cells, _y_cells, _t_cells, nMesh, stepSize, vertexCount,
+			[this, nMesh, stepSize, vertexCount](int t, quint16* slice) {
+				QVector<MeshVertex> vertices;
+				QVector<unsigned int> indices;
+				buildMesh(t, nMesh, stepSize, false, vertices, indices);
+				for (int i = 0; i < vertexCount; i++) {
+					slice[2 * i + 0] = vertices[i].x;
+					slice[2 * i + 1] = vertices[i].y;
+				}
+			});
+		return false;
+	}
+
+	// The positions are streamed from the cache into their own buffer; the
+	// texture coordinates come from the mesh vertices, which do not change
+	if (_vaoBaked == 0) {
+		glGenVertexArrays(1, &_vaoBaked);
+		glGenBuffers(3, _bakedBuffers);
+		glBindVertexArray(_vaoBaked);
+		glBindBuffer(GL_ARRAY_BUFFER, _bakedBuffers[1]);
+		setMeshVertexFormat();
+		glBindBuffer(GL_ARRAY_BUFFER, _bakedBuffers[0]);
+		glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_TRUE, 0, 0);
+	}
+	glBindVertexArray(_vaoBaked);
+	glBindBuffer(GL_ARRAY_BUFFER, _bakedBuffers[1]);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex), vertices.constData(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _bakedBuffers[2]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.constData(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	Cg::trackResource(Cg::VertexArrayResource, _vaoBaked);
+	Cg::trackResource(Cg::BufferResource, _bakedBuffers[1], vertices.size() * sizeof(MeshVertex));
+	Cg::trackResource(Cg::BufferResource, _bakedBuffers[2], indices.size() * sizeof(unsigned int));
+	_indexCountBaked = indices.size();
+	CG_ASSERT_GLCHECK();
+	return true;
+}
+
+/* Creates a mesh with nMesh quads in y direction and distorts it in the
+ * direction of the flow of time cell t with the given step size. The uniform
+ * mesh only reads the flow field, so it can be built for several time cells
+ * in parallel, also while the mesh parameters of the interactive advection
+ * change; the adaptive mesh uses the derived fields cache.
+ * Quads of the uniform mesh that are marked in staticQuads are left out, and
+ * vertices they share with the remaining quads stay in place. */
+template<class Vertex>
+void FlowVis::buildMesh(int t, int nMesh, float stepSize, bool adaptive, QVector<Vertex>& vertices,
+		QVector<unsigned int>& indices, const QVector<bool>& staticQuads) {
+	float width = _x_cells;
+	float height = _y_cells;
+	int NMESH_Y = nMesh;
+	float DIST = height / NMESH_Y;
+	int NMESH_X = width / DIST;
+
+	unsigned int vertexCount = 0;
+	QVector2D pos;
 	float offset = 0.1f;
 
+	// Advects the vertex at corner (i, j) of the uniform mesh, unless it
+	// belongs to a static quad
+	bool cull = !adaptive && !staticQuads.isEmpty();
+	auto advected = [&](int i, int j, float x, float y) {
+		if (cull) {
+			for (int a = std::max(i - 1, 0); a <= std::min(i, NMESH_X - 1); a++)
+				for (int b = std::max(j - 1, 0); b <= std::min(j, NMESH_Y - 1); b++)
+					if (staticQuads[a * NMESH_Y + b])
+						return QVector2D(x, y);
+		}
+		return _field.heun(stepSize, QVector2D(x, y), t);
+	};
+
 	// add a border to the left edge to fix texture/background injection bug
 	for (int i = 0; i < NMESH_Y; i++) {
 		float x1 = 0;
@@ -383,81 +1127,574 @@ void FlowVis::createMesh() {
 		float y1 = DIST * i;
 		float y2 = y1 + DIST;
 
-		pos = QVector3D(QVector2D(x1, y2));
-		positions.append({ pos.x(), pos.y(), pos.z() });
-		normals.append({ 0.0f, 0.0f, 1.0f });
-		texcoords.append({ texTF(x1, width), texTF(y2, height) });
+		pos = QVector2D(x1, y2);
+		appendVertex(vertices, pos, x1, y2);
 
-		pos = QVector3D(heun(_stepSize, QVector2D(x2, y2)));
-		positions.append({ pos.x(), pos.y(), pos.z() });
-		normals.append({ 0.0f, 0.0f, 1.0f });
-		texcoords.append({ texTF(x2, width), texTF(y2, height) });
+		pos = advected(0, i + 1, x2, y2);
+		appendVertex(vertices, pos, x2, y2);
 
-		pos = QVector3D(heun(_stepSize, QVector2D(x2, y1)));
-		positions.append({ pos.x(), pos.y(), pos.z() });
-		normals.append({ 0.0f, 0.0f, 1.0f });
-		texcoords.append({ texTF(x2, width), texTF(y1, height) });
+		pos = advected(0, i, x2, y1);
+		appendVertex(vertices, pos, x2, y1);
 
-		pos = QVector3D(QVector2D(x1, y1));
-		positions.append({ pos.x(), pos.y(), pos.z() });
-		normals.append({ 0.0f, 0.0f, 1.0f });
-		texcoords.append({ texTF(x1, width), texTF(y1, height) });
+		pos = QVector2D(x1, y1);
+		appendVertex(vertices, pos, x1, y1);
 
-		indices.append({ _indexCountMesh, _indexCountMesh + 1, _indexCountMesh + 3, _indexCountMesh + 1, _indexCountMesh + 2, _indexCountMesh + 3 });
-		_indexCountMesh += 4;
+		indices.append({ vertexCount, vertexCount + 1, vertexCount + 3, vertexCount + 1, vertexCount + 2, vertexCount + 3 });
+		vertexCount += 4;
 	}
 
-	for (int i = 0; i < NMESH_X; i++) {
-		// plus offset when using the border
-		float x1 = DIST * i + offset;
-		float x2 = x1 + DIST;
+	if (adaptive) {
+		appendAdaptiveMesh(t, nMesh, stepSize, vertices, indices, offset);
+	} else {
+		for (int i = 0; i < NMESH_X; i++) {
+			// plus offset when using the border
+			float x1 = DIST * i + offset;
+			float x2 = x1 + DIST;
 
-		for (int j = 0; j < NMESH_Y; j++) {
-			float y1 = DIST * j;
-			float y2 = y1 + DIST;
+			for (int j = 0; j < NMESH_Y; j++) {
+				if (cull && staticQuads[i * NMESH_Y + j])
+					continue;
+				float y1 = DIST * j;
+				float y2 = y1 + DIST;
 
-			pos = QVector3D(heun(_stepSize, QVector2D(x1, y2)));
-			positions.append({ pos.x(), pos.y(), pos.z() });
-			normals.append({ 0.0f, 0.0f, 1.0f });
-			texcoords.append({ texTF(x1, width), texTF(y2, height) });
+				pos = advected(i, j + 1, x1, y2);
+				appendVertex(vertices, pos, x1, y2);
 
-			pos = QVector3D(heun(_stepSize, QVector2D(x2, y2)));
-			positions.append({ pos.x(), pos.y(), pos.z() });
-			normals.append({ 0.0f, 0.0f, 1.0f });
-			texcoords.append({ texTF(x2, width), texTF(y2, height) });
+				pos = advected(i + 1, j + 1, x2, y2);
+				appendVertex(vertices, pos, x2, y2);
 
-			pos = QVector3D(heun(_stepSize, QVector2D(x2, y1)));
-			positions.append({ pos.x(), pos.y(), pos.z() });
-			normals.append({ 0.0f, 0.0f, 1.0f });
-			texcoords.append({ texTF(x2, width), texTF(y1, height) });
+				pos = advected(i + 1, j, x2, y1);
+				appendVertex(vertices, pos, x2, y1);
 
-			pos = QVector3D(heun(_stepSize, QVector2D(x1, y1)));
-			positions.append({ pos.x(), pos.y(), pos.z() });
-			normals.append({ 0.0f, 0.0f, 1.0f });
-			texcoords.append({ texTF(x1, width), texTF(y1, height) });
+				pos = advected(i, j, x1, y1);
+				appendVertex(vertices, pos, x1, y1);
 
-			indices.append({ _indexCountMesh, _indexCountMesh + 1, _indexCountMesh + 3, _indexCountMesh + 1, _indexCountMesh + 2, _indexCountMesh + 3 });
-			_indexCountMesh += 4;
+				indices.append({ vertexCount, vertexCount + 1, vertexCount + 3, vertexCount + 1, vertexCount + 2, vertexCount + 3 });
+				vertexCount += 4;
+			}
+		}
+	}
+}
+
+/* Appends a quadtree mesh that starts from 8x8 quads of the uniform mesh
+ * and subdivides them where the displacement varies too much across a quad,
+ * i.e. where the velocity gradient is high. Neighboring quads differ by at
+ * most one level, and quads next to finer ones are triangulated as a fan that
+ * includes the hanging vertices, so there are no cracks. Vertices are shared
+ * and advected only once. */
+template<class Vertex>
+void FlowVis::appendAdaptiveMesh(int t, int nMesh, float stepSize, QVector<Vertex>& vertices,
+		QVector<unsigned int>& indices, float offset) {
+	float width = _x_cells;
+	float height = _y_cells;
+	const int NMESH_Y = nMesh;
+	const float DIST = height / NMESH_Y;
+	const int NMESH_X = width / DIST;
+	const int rootSize = 8;           // in quads of the uniform mesh
+	const float tolerance = 0.05f;    // allowed displacement variation in cells
+
+	// Frobenius norm of the Jacobian per cell, in cell units
+	const QVector<float>& jacobian = _derived.data(DerivedFields::Jacobian, t);
+	QVector<float> gradient(_x_cells * _y_cells);
+	for (int i = 0; i < gradient.size(); i++) {
+		float dudx = jacobian[4 * i + 0] * _x_step;
+		float dudy = jacobian[4 * i + 1] * _y_step;
+		float dvdx = jacobian[4 * i + 2] * _x_step;
+		float dvdy = jacobian[4 * i + 3] * _y_step;
+		gradient[i] = std::sqrt(dudx * dudx + dudy * dudy + dvdx * dvdx + dvdy * dvdy);
+	}
+	auto needsRefinement = [&](int x, int y, int s) {
+		int cx0 = std::max(static_cast<int>(std::floor(offset + x * DIST)), 0);
+		int cx1 = std::min(static_cast<int>(std::ceil(offset + (x + s) * DIST)), _x_cells - 1);
+		int cy0 = std::max(static_cast<int>(std::floor(y * DIST)), 0);
+		int cy1 = std::min(static_cast<int>(std::ceil((y + s) * DIST)), _y_cells - 1);
+		float maxGradient = 0.0f;
+		for (int cy = cy0; cy <= cy1; cy++)
+			for (int cx = cx0; cx <= cx1; cx++)
+				maxGradient = std::max(maxGradient, gradient[cy * _x_cells + cx]);
+		return stepSize * maxGradient * s * DIST > tolerance;
+	};
+
+	// Build the quadtree; leaves are (x, y, size) in quads of the uniform mesh
+	struct Leaf { int x, y, s; };
+	QVector<Leaf> stack, leaves;
+	for (int y = 0; y < NMESH_Y; y += rootSize)
+		for (int x = 0; x < NMESH_X; x += rootSize)
+			stack.append({ x, y, rootSize });
+	while (!stack.isEmpty()) {
+		Leaf l = stack.takeLast();
+		if (l.x >= NMESH_X || l.y >= NMESH_Y)
+			continue;
+		bool partiallyOutside = (l.x + l.s > NMESH_X || l.y + l.s > NMESH_Y);
+		if (l.s > 1 && (partiallyOutside || needsRefinement(l.x, l.y, l.s))) {
+			int h = l.s / 2;
+			stack.append({ l.x, l.y, h });
+			stack.append({ l.x + h, l.y, h });
+			stack.append({ l.x, l.y + h, h });
+			stack.append({ l.x + h, l.y + h, h });
+		} else {
+			leaves.append(l);
+		}
+	}
+
+	// Leaf size for each quad of the uniform mesh. Outside the domain, neighbors
+	// count as coarse, except for the left border strip, which has a vertex per quad.
+	QVector<int> leafSize(NMESH_X * NMESH_Y);
+	auto sizeAt = [&](int x, int y) {
+		if (y < 0 || y >= NMESH_Y || x >= NMESH_X)
+			return rootSize;
+		if (x < 0)
+			return 1;
+		return leafSize[y * NMESH_X + x];
+	};
+	auto updateLeafSize = [&]() {
+		for (const Leaf& l : leaves)
+			for (int y = l.y; y < l.y + l.s; y++)
+				for (int x = l.x; x < l.x + l.s; x++)
+					leafSize[y * NMESH_X + x] = l.s;
+	};
+
+	// Split leaves until neighbors differ by at most one level
+	for (bool changed = true; changed; ) {
+		changed = false;
+		updateLeafSize();
+		QVector<Leaf> balanced;
+		for (const Leaf& l : leaves) {
+			bool split = false;
+			for (int k = 0; l.s > 1 && k < l.s && !split; k++) {
+				split = sizeAt(l.x - 1, l.y + k) < l.s / 2 || sizeAt(l.x + l.s, l.y + k) < l.s / 2
+					|| sizeAt(l.x + k, l.y - 1) < l.s / 2 || sizeAt(l.x + k, l.y + l.s) < l.s / 2;
+			}
+			if (split) {
+				int h = l.s / 2;
+				balanced.append({ l.x, l.y, h });
+				balanced.append({ l.x + h, l.y, h });
+				balanced.append({ l.x, l.y + h, h });
+				balanced.append({ l.x + h, l.y + h, h });
+				changed = true;
+			} else {
+				balanced.append(l);
+			}
+		}
+		leaves = balanced;
+	}
+
+	// Vertices are addressed in half quads, so that leaf centers are on the grid
+	QHash<int, unsigned int> vertexIndices;
+	auto vertex = [&](int vx, int vy) {
+		int key = vy * (2 * NMESH_X + 1) + vx;
+		auto it = vertexIndices.constFind(key);
+		if (it != vertexIndices.constEnd())
+			return it.value();
+		float x = offset + vx * DIST / 2.0f;
+		float y = vy * DIST / 2.0f;
+		QVector2D pos = _field.heun(stepSize, QVector2D(x, y), t);
+		unsigned int index = vertices.size();
+		appendVertex(vertices, pos, x, y);
+		vertexIndices.insert(key, index);
+		return index;
+	};
+
+	QVector<unsigned int> ring;
+	for (const Leaf& l : leaves) {
+		int x0 = 2 * l.x, y0 = 2 * l.y, x1 = 2 * (l.x + l.s), y1 = 2 * (l.y + l.s);
+		int h = l.s / 2;
+		bool bottom = l.s > 1 && (sizeAt(l.x + h - 1, l.y - 1) < l.s || sizeAt(l.x + h, l.y - 1) < l.s);
+		bool right = l.s > 1 && (sizeAt(l.x + l.s, l.y + h - 1) < l.s || sizeAt(l.x + l.s, l.y + h) < l.s);
+		bool top = l.s > 1 && (sizeAt(l.x + h - 1, l.y + l.s) < l.s || sizeAt(l.x + h, l.y + l.s) < l.s);
+		bool left = l.s > 1 && (sizeAt(l.x - 1, l.y + h - 1) < l.s || sizeAt(l.x - 1, l.y + h) < l.s);
+		if (!bottom && !right && !top && !left) {
+			unsigned int tl = vertex(x0, y1), tr = vertex(x1, y1), br = vertex(x1, y0), bl = vertex(x0, y0);
+			indices.append({ tl, tr, bl, tr, br, bl });
+		} else {
+			// fan around the center that includes the hanging vertices on the edges
+			int xm = (x0 + x1) / 2, ym = (y0 + y1) / 2;
+			ring.clear();
+			ring.append(vertex(x0, y0));
+			if (bottom)
+				ring.append(vertex(xm, y0));
+			ring.append(vertex(x1, y0));
+			if (right)
+				ring.append(vertex(x1, ym));
+			ring.append(vertex(x1, y1));
+			if (top)
+				ring.append(vertex(xm, y1));
+			ring.append(vertex(x0, y1));
+			if (left)
+				ring.append(vertex(x0, ym));
+			unsigned int center = vertex(xm, ym);
+			for (int i = 0; i < ring.size(); i++)
+				indices.append({ center, ring[i], ring[(i + 1) % ring.size()] });
 		}
 	}
-	
-	// Delete if not initial call, so the name can be used again
-	if (_vaoMesh != 0)
-		glDeleteVertexArrays(1, &_vaoMesh);
-	
-	_vaoMesh = Cg::createVertexArrayObject(positions, normals, texcoords, indices);
-	_indexCountMesh = indices.size();
 }
 
-/* Resizes the textures of the FBOs */
-void FlowVis::fboTexResize() {
-	GLsizei SCR_WIDTH = _screenWidth;
-	GLsizei SCR_HEIGHT = _screenHeight;
+/* Returns the resolution of the advection targets for a window of size w x h */
+QSize FlowVis::wantedAdvectionSize(int w, int h) const {
+	switch (_resolutionMode) {
+	case 1:
+		return QSize(std::max(1, int(w * _resolutionFraction)), std::max(1, int(h * _resolutionFraction)));
+	case 2:
+		return QSize(_fixedAdvectionWidth, _fixedAdvectionHeight);
+	case 3: {
+		// an integer number of pixels per cell, as many as the window width allows
+		int pixelsPerCell = std::max(1, w / _x_cells);
+		return QSize(pixelsPerCell * _x_cells, pixelsPerCell * _y_cells);
+	}
+	default:
+		return QSize(w, h);
+	}
+}
+
+/* Reallocates the textures of the FBOs at the given size, with the given
+ * number of color targets. The advected images are scaled into the new
+ * textures so that the history is not lost. */
+void FlowVis::fboTexResize(int width, int height, int targetCount) {
+	static const GLenum attachments[_maxTargets] = {
+		GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3
+	};
+	int buffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &buffer);
+	// Poster tiles must not wrap around at the domain border, since their
+	// opposite edge is not the one of the domain
+	GLint wrap = _posterSize.isValid() ? GL_CLAMP_TO_EDGE : GL_REPEAT;
 
+	GLuint blitFB;
+	glGenFramebuffers(1, &blitFB);
 	for (int i = 0; i < 2; i++) {
-		glBindTexture(GL_TEXTURE_2D, _meshTexture[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
+		for (int k = 0; k < _maxTargets; k++) {
+			GLuint texture = 0;
+			if (k < targetCount) {
+				glGenTextures(1, &texture);
+				glBindTexture(GL_TEXTURE_2D, texture);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+				Cg::trackResource(Cg::TextureResource, texture, Cg::textureBytes(GL_RGBA8, width, height));
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+
+				// copy the old content, scaled to the new size
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, blitFB);
+				glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+				if (_meshTexture[i][k] != 0) {
+					glBindFramebuffer(GL_READ_FRAMEBUFFER, _meshFB[i]);
+					glReadBuffer(attachments[k]);
+					glBlitFramebuffer(0, 0, _advectionWidth, _advectionHeight, 0, 0, width, height,
+						GL_COLOR_BUFFER_BIT, GL_LINEAR);
+				} else {
+					glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+					glClear(GL_COLOR_BUFFER_BIT);
+				}
+			}
+
+			glBindFramebuffer(GL_FRAMEBUFFER, _meshFB[i]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[k], GL_TEXTURE_2D, texture, 0);
+			if (_meshTexture[i][k] != 0) {
+				glDeleteTextures(1, &_meshTexture[i][k]);
+				Cg::untrackResource(Cg::TextureResource, _meshTexture[i][k]);
+			}
+			_meshTexture[i][k] = texture;
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, _meshFB[i]);
+		glDrawBuffers(targetCount, attachments);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
 	}
+	glDeleteFramebuffers(1, &blitFB);
+
+	// the noise resolution follows the framebuffers; it is rendered anew for every step
+	glBindTexture(GL_TEXTURE_2D, _noiseTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+	Cg::trackResource(Cg::TextureResource, _noiseTexture, Cg::textureBytes(GL_RGBA8, width, height));
+
+	_advectionWidth = width;
+	_advectionHeight = height;
+	_targetCount = targetCount;
+	// the checkpoints no longer match the targets
+	clearCheckpoints();
+	glBindFramebuffer(GL_FRAMEBUFFER, buffer);
+	CG_ASSERT_GLCHECK();
+}
+
+/* Renders the advection of the last _posterSteps time cells up to the current
+ * one at a resolution that may exceed the framebuffer limits, into a binary
+ * PPM file. The domain is split into tiles that are advected one after the
+ * other. Each tile is extended by a halo as wide as the flow can carry
+ * texture in that time, so the seams are invisible, and only its core is
+ * written to the file. At most one tile is held in memory. */
+void FlowVis::renderPoster(int width, const QString& filename) {
+	int height = width * _y_cells / _x_cells;
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+		std::cout << "Cannot write " << filename.toStdString() << std::endl;
+		return;
+	}
+	QByteArray header = QString("P6\n%1 %2\n255\n").arg(width).arg(height).toLatin1();
+	file.write(header);
+	if (!file.resize(header.size() + qint64(width) * height * 3)) {
+		std::cout << "Cannot write " << filename.toStdString() << std::endl;
+		return;
+	}
+
+	// The tiles, including their halos, must fit into a framebuffer
+	GLint maxTextureSize, maxRenderbufferSize, maxViewportDims[2];
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+	glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+	glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewportDims);
+	int maxTileSize = std::min(std::min(maxTextureSize, maxRenderbufferSize),
+		std::min(std::min(maxViewportDims[0], maxViewportDims[1]), 8192));
+
+	// The halo covers the longest distance the flow travels in _posterSteps
+	// steps, plus one cell for the interpolation
+	int startTime = (_time_cell - _posterSteps + _t_cells) % _t_cells;
+	float haloCells = 1.0f;
+	for (int i = 0; i < _posterSteps; i++) {
+		float minValue, maxValue;
+		_derived.range(DerivedFields::Magnitude, (startTime + i) % _t_cells, &minValue, &maxValue);
+		haloCells += _stepSize * maxValue;
+	}
+	float pixelsPerCell = float(width) / _x_cells;
+	int halo = std::ceil(haloCells * pixelsPerCell);
+	int tileSize = maxTileSize - 2 * halo;
+	if (tileSize < 64) {
+		std::cout << "Cannot render a poster with " << width << " pixels: the halo of "
+			<< halo << " pixels does not fit into a framebuffer" << std::endl;
+		return;
+	}
+
+	// Save the state of the interactive advection
+	int buffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &buffer);
+	QMatrix4x4 orthoMatrix = _ortho_matrix;
+	int advectionWidth = _advectionWidth;
+	int advectionHeight = _advectionHeight;
+	int timeCell = _time_cell;
+	_posterSize = QSize(width, height);
+
+	QVector<unsigned char> pixels;
+	int tilesX = (width + tileSize - 1) / tileSize;
+	int tilesY = (height + tileSize - 1) / tileSize;
+	for (int ty = 0; ty < tilesY; ty++) {
+		for (int tx = 0; tx < tilesX; tx++) {
+			// core and halo of the tile in pixels; there is no halo beyond the domain
+			int x0 = tx * tileSize;
+			int y0 = ty * tileSize;
+			int x1 = std::min(x0 + tileSize, width);
+			int y1 = std::min(y0 + tileSize, height);
+			int hx0 = std::max(x0 - halo, 0);
+			int hy0 = std::max(y0 - halo, 0);
+			int hx1 = std::min(x1 + halo, width);
+			int hy1 = std::min(y1 + halo, height);
+			// the textures are created anew for each tile, with the wrap mode of posters
+			_posterTile = QRect(hx0, hy0, hx1 - hx0, hy1 - hy0);
+			fboTexResize(hx1 - hx0, hy1 - hy0, _targetCount);
+			_ortho_matrix.setToIdentity();
+			_ortho_matrix.ortho(hx0 / pixelsPerCell, hx1 / pixelsPerCell,
+				hy0 * float(_y_cells) / height, hy1 * float(_y_cells) / height, 1.0f, -1.0f);
+
+			_time_cell = startTime;
+			_first_iteration = true;
+			_meshIteration = false;
+			advect(_posterSteps);
+
+			// read the core back and put its rows into the file, top row first
+			pixels.resize((x1 - x0) * (y1 - y0) * 3);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, _meshFB[!_meshIteration]);
+			glReadBuffer(GL_COLOR_ATTACHMENT0);
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glReadPixels(x0 - hx0, y0 - hy0, x1 - x0, y1 - y0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+			glPixelStorei(GL_PACK_ALIGNMENT, 4);
+			for (int y = y0; y < y1; y++) {
+				file.seek(header.size() + (qint64(height - 1 - y) * width + x0) * 3);
+				file.write(reinterpret_cast<const char*>(pixels.constData()) + (y - y0) * (x1 - x0) * 3,
+					(x1 - x0) * 3);
+			}
+			std::cout << "poster tile " << ty * tilesX + tx + 1 << "/" << tilesX * tilesY << std::endl;
+		}
+	}
+	file.close();
+	std::cout << "wrote " << width << "x" << height << " poster to " << filename.toStdString() << std::endl;
+
+	// Restore the interactive advection; it starts over from the seed
+	_posterSize = QSize();
+	_ortho_matrix = orthoMatrix;
+	fboTexResize(advectionWidth, advectionHeight, _targetCount);
+	_time_cell = timeCell;
+	_first_iteration = true;
+	_meshIteration = false;
+	glBindFramebuffer(GL_FRAMEBUFFER, buffer);
+	resetTiming();
+	CG_ASSERT_GLCHECK();
+}
+
+/* Starts reading the latest advection state of all targets back as the
+ * checkpoint of the current step. The state goes into one of two pixel
+ * buffers that are used in turn and guarded by fences, like in FlowRange,
+ * and is compressed and stored by fetchCheckpoints() once it has arrived,
+ * so that the playback never waits for the readback. If both buffers are
+ * still in flight, this checkpoint is skipped. */
+void FlowVis::saveCheckpoint() {
+	fetchCheckpoints();
+	int i = _checkpointNext;
+	if (_checkpointFence[i])
+		return;
+
+	int size = _advectionWidth * _advectionHeight * 4;
+	if (_checkpointPBO[i] == 0)
+		glGenBuffers(1, &_checkpointPBO[i]);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, _checkpointPBO[i]);
+	if (_checkpointPBOSize[i] != size * _targetCount) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size * _targetCount, nullptr, GL_STREAM_READ);
+		Cg::trackResource(Cg::BufferResource, _checkpointPBO[i], size * _targetCount);
+		_checkpointPBOSize[i] = size * _targetCount;
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, _meshFB[!_meshIteration]);
+	for (int k = 0; k < _targetCount; k++) {
+		glReadBuffer(GL_COLOR_ATTACHMENT0 + k);
+		glReadPixels(0, 0, _advectionWidth, _advectionHeight, GL_RGBA, GL_UNSIGNED_BYTE,
+			reinterpret_cast<void*>(quintptr(k) * size));
+	}
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	_checkpointFence[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	_checkpointStep[i] = _step;
+	_checkpointTime[i] = _time_cell;
+	_checkpointNext = !_checkpointNext;
+	CG_ASSERT_GLCHECK();
+}
+
+/* Stores the checkpoints of all pixel buffers whose fence has signaled, oldest first */
+void FlowVis::fetchCheckpoints() {
+	for (int j = 0; j < 2; j++) {
+		int i = (_checkpointNext + j) % 2;
+		if (!_checkpointFence[i])
+			continue;
+		GLenum status = glClientWaitSync(_checkpointFence[i], 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		glDeleteSync(_checkpointFence[i]);
+		_checkpointFence[i] = 0;
+		if (_checkpointStep[i] < 0)
+			continue;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, _checkpointPBO[i]);
+		const char* state = static_cast<const char*>(
+				glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, _checkpointPBOSize[i], GL_MAP_READ_BIT));
+		if (state) {
+			_checkpoints.insert(_checkpointStep[i], _checkpointTime[i], state, _checkpointPBOSize[i]);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+}
+
+/* Drops all checkpoints, including those whose readback is still in flight.
+ * Needs no OpenGL context; fetchCheckpoints() deletes the fences later. */
+void FlowVis::clearCheckpoints() {
+	_checkpoints.clear();
+	_checkpointStep[0] = _checkpointStep[1] = -1;
+}
+
+/* Brings the advection to the given step: restores the nearest checkpoint
+ * before it, unless the current state is closer, and advects the remaining
+ * steps. Returns false if there is no way to get there. */
+bool FlowVis::seek(int step) {
+	fetchCheckpoints();
+	int checkpoint = _checkpoints.nearest(step);
+	if (step >= _step && checkpoint <= _step) {
+		advect(step - _step);
+		return true;
+	}
+	if (checkpoint < 0)
+		return false;
+
+	int size = _advectionWidth * _advectionHeight * 4;
+	int timeCell;
+	QByteArray state = _checkpoints.state(checkpoint, &timeCell);
+	if (state.size() != size * _targetCount)
+		return false;
+	for (int k = 0; k < _targetCount; k++) {
+		glBindTexture(GL_TEXTURE_2D, _meshTexture[!_meshIteration][k]);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _advectionWidth, _advectionHeight,
+			GL_RGBA, GL_UNSIGNED_BYTE, state.constData() + k * size);
+	}
+	CG_ASSERT_GLCHECK();
+	_step = checkpoint;
+	_time_cell = timeCell;
+	advect(step - checkpoint);
+	return true;
+}
+
+/* Computes the finite-time Lyapunov exponent over the next _ftleSlices time
+ * cells from the composed flow map and uploads it */
+void FlowVis::updateFTLE() {
+	if (_ftleTime == _time_cell && _ftleStepSize == _stepSize)
+		return;
+	_ftleTime = _time_cell;
+	_ftleStepSize = _stepSize;
+
+	_flowMaps.setStepSize(_stepSize);
+	int t1 = std::min(_time_cell + _ftleSlices, _t_cells - 1);
+	QVector<float> map = _flowMaps.map(_time_cell, t1);
+	int w = _flowMaps.xNodes();
+	int h = _flowMaps.yNodes();
+	float duration = t1 - _time_cell;
+	QVector<float> ftle(w * h, 0.0f);
+	_ftleMax = 0.0f;
+	for (int y = 0; y < h && duration > 0.0f; y++) {
+		int y0 = std::max(y - 1, 0);
+		int y1 = std::min(y + 1, h - 1);
+		for (int x = 0; x < w; x++) {
+			int x0 = std::max(x - 1, 0);
+			int x1 = std::min(x + 1, w - 1);
+			// gradient of the flow map and the largest eigenvalue of the Cauchy-Green tensor
+			float a = (map[2 * (y * w + x1)] - map[2 * (y * w + x0)]) / (x1 - x0);
+			float b = (map[2 * (y1 * w + x)] - map[2 * (y0 * w + x)]) / (y1 - y0);
+			float c = (map[2 * (y * w + x1) + 1] - map[2 * (y * w + x0) + 1]) / (x1 - x0);
+			float d = (map[2 * (y1 * w + x) + 1] - map[2 * (y0 * w + x) + 1]) / (y1 - y0);
+			float c11 = a * a + c * c;
+			float c12 = a * b + c * d;
+			float c22 = b * b + d * d;
+			float lambda = 0.5f * (c11 + c22) + std::sqrt(0.25f * (c11 - c22) * (c11 - c22) + c12 * c12);
+			float value = lambda > 0.0f ? std::log(std::sqrt(lambda)) / duration : 0.0f;
+			ftle[y * w + x] = value;
+			_ftleMax = std::max(_ftleMax, value);
+		}
+	}
+
+	if (_ftleTexture == 0) {
+		glGenTextures(1, &_ftleTexture);
+		glBindTexture(GL_TEXTURE_2D, _ftleTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, w, h, 0, GL_RED, GL_FLOAT, ftle.constData());
+		Cg::trackResource(Cg::TextureResource, _ftleTexture, Cg::textureBytes(GL_R32F, w, h));
+	} else {
+		glBindTexture(GL_TEXTURE_2D, _ftleTexture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RED, GL_FLOAT, ftle.constData());
+	}
+	CG_ASSERT_GLCHECK();
+}
+
+/* Computes the LIC image of the current time slice and uploads it */
+void FlowVis::updateLIC(int w, int h) {
+	if (!_lic.update(_field, _time_cell, w, h))
+		return;
+
+	glBindTexture(GL_TEXTURE_2D, _licTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (_licTextureSize != QSize(w, h)) {
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, _lic.image().constData());
+		_licTextureSize = QSize(w, h);
+		Cg::trackResource(Cg::TextureResource, _licTexture, Cg::textureBytes(GL_R8, w, h));
+	} else {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RED, GL_UNSIGNED_BYTE, _lic.image().constData());
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	CG_ASSERT_GLCHECK();
 }
 
 void FlowVis::keyPressEvent(QKeyEvent* event)
@@ -497,14 +1734,99 @@ void FlowVis::keyPressEvent(QKeyEvent* event)
 		_stepSize -= 0.05;
 		if (_stepSize < 0.05)
 			_stepSize = 0.05;
+		// the checkpoints were advected with the old step size
+		clearCheckpoints();
 		break;
 	case Qt::Key_J:
 		_stepSize += 0.05;
+		clearCheckpoints();
+		break;
+	case Qt::Key_Left:
+		// seek backwards and forwards by one checkpoint interval
+		_seekStep = std::max(_step - _checkpointInterval, 0);
+		break;
+	case Qt::Key_Right:
+		_seekStep = _step + _checkpointInterval;
+		break;
+	case Qt::Key_Down:
+		// play backwards, by restoring checkpoints and advecting forwards from them
+		_reversePlayback = !_reversePlayback;
+		break;
+	case Qt::Key_Period:
+		// more advection steps per displayed frame
+		_substepsPerFrame = std::min(_substepsPerFrame * 2.0f, 16.0f);
+		break;
+	case Qt::Key_Comma:
+		// fewer advection steps per displayed frame
+		_substepsPerFrame = std::max(_substepsPerFrame / 2.0f, 1.0f / 8.0f);
+		break;
+	case Qt::Key_P:
+		// switch between mesh and per-pixel advection
+		_pixelAdvection = !_pixelAdvection;
+		_first_iteration = true;
+		_meshIteration = false;
+		resetTiming();
+		break;
+	case Qt::Key_0:
+		// cycle through procedural white, Perlin and spot noise, and off
+		_noiseType = (_noiseType + 1) % 4;
+		_noiseSeed = rand();
+		_first_iteration = true;
+		_meshIteration = false;
+		break;
+	case Qt::Key_R:
+		// cycle through window, fractional, fixed and data-aligned advection resolution
+		_resolutionMode = (_resolutionMode + 1) % 4;
+		break;
+	case Qt::Key_M:
+		// advect the comparison seed images alongside the current one
+		_compareSeeds = !_compareSeeds;
+		_first_iteration = true;
+		_meshIteration = false;
+		break;
+	case Qt::Key_X:
+		// render a poster at the next frame, when the OpenGL context is current
+		_posterRequested = true;
+		break;
+	case Qt::Key_K:
+		// replay the uniform mesh from a cache file, baked when first needed
+		_useBake = !_useBake;
+		break;
+	case Qt::Key_E:
+		// integrate only the quads of the uniform mesh that move noticeably
+		_cullStatic = !_cullStatic;
+		break;
+	case Qt::Key_G:
+		// live GL objects and their estimated memory
+		Cg::reportResources();
+		break;
+	case Qt::Key_O:
+		// print the advection cost every 100 frames
+		_timingReport = !_timingReport;
+		resetTiming();
+		break;
+	case Qt::Key_A:
+		_adaptiveMesh = !_adaptiveMesh;
+		_first_iteration = true;
+		_meshIteration = false;
+		break;
+	case Qt::Key_V:
+		// cycle through seed image, magnitude, vorticity, divergence, color-mapped magnitude and FTLE
+		_fieldView = (_fieldView + 1) % (_ftleView + 1);
+		break;
+	case Qt::Key_L:
+		// cycle through LIC with each noise image, and off
+		_licMode = (_licMode + 1) % (_licNoise.size() + 1);
+		if (_licMode > 0)
+			_lic.setNoise(_licNoise[_licMode - 1]);
+		_first_iteration = true;
+		_meshIteration = false;
 		break;
 	}
 	// Key pressed is between 1 and 9; change the current image
 	if (key >= 49 && key <= 57) {
-		_currentImage = _texImages[(key - 49) % _texImages.size()];
+		_seedLayer = (key - 49) % _seedLayers;
+		_noiseType = 0;
 		_first_iteration = true;
 		_meshIteration = false;
 	}
@@ -1,10 +1,22 @@
 #ifndef FLOWVIS_HPP
 #define FLOWVIS_HPP
 
+#include <QElapsedTimer>
+#include <QRect>
 #include <QOpenGLShaderProgram>
 #include <QVector3D>
 
 #include "cgbase/cgopenglwidget.hpp"
+#include "cgbase/cgvertexarray.hpp"
+
+#include "flowfield.hpp"
+#include "flowderived.hpp"
+#include "flowmap.hpp"
+#include "flowbounds.hpp"
+#include "flowlic.hpp"
+#include "flowrange.hpp"
+#include "flowcheckpoints.hpp"
+#include "flowbake.hpp"
 
 class FlowVis : public Cg::OpenGLWidget
 {
@@ -25,6 +37,9 @@ private:
 	static constexpr float _t_step = (_t_end - _t_start) / _t_cells;
 	// The flow data
 	QVector<float> _data;
+	FlowField _field;
+	DerivedFields _derived;
+	FlowMaps _flowMaps;
 	// State
 	int _time_cell;
 	int _time_cell_in_texture;
@@ -32,31 +47,162 @@ private:
 	bool _first_iteration;
 	bool _meshIteration;
 	bool _blendOn;
-	// Parameters for the screen and mesh
-	int _screenWidth;
-	int _screenHeight;
+	bool _adaptiveMesh;
+	float _substepsPerFrame; // advection steps per displayed frame, may be below one
+	float _substepBudget;    // fraction of a step carried over to the next frame
+	bool _pixelAdvection;    // per-pixel backward advection instead of the mesh
+	int _noiseType; // 0: seed image, 1: white, 2: Perlin, 3: spot noise
+	unsigned int _noiseSeed;
+	static constexpr int _noisePeriod = 32; // time cells
+	bool _compareSeeds;      // advect comparison seed images in additional targets
+	int _licMode; // 0: off, otherwise index into _licNoise plus one
+	int _fieldView; // 0: seed image, otherwise DerivedFields::Quantity plus one, or _colorMapView
+	static constexpr int _colorMapView = DerivedFields::Divergence + 2;
+	static constexpr int _ftleView = _colorMapView + 1;
+	// Resolution of the advection framebuffers, independent of the window
+	int _resolutionMode; // 0: window, 1: fraction of the window, 2: fixed, 3: data-aligned
+	static constexpr float _resolutionFraction = 0.5f;
+	static constexpr int _fixedAdvectionWidth = 2048;
+	static constexpr int _fixedAdvectionHeight = 256;
+	static constexpr qint64 _resizeDelay = 200; // milliseconds
+	int _advectionWidth;
+	int _advectionHeight;
+	QSize _pendingAdvectionSize;
+	QElapsedTimer _resizeTimer;
+	// Tiled rendering of posters beyond the framebuffer limits
+	static constexpr int _posterWidth = 16384;
+	static constexpr int _posterSteps = 50; // enough for the blended seed to fade in
+	bool _posterRequested;
+	QSize _posterSize; // valid while a poster is rendered
+	QRect _posterTile; // the current tile including its halo, in poster pixels
+	// Checkpoints of the advection state for seeking and reverse playback
+	static constexpr int _checkpointInterval = 25; // steps
+	static constexpr qint64 _checkpointMemoryBudget = 256 << 20;
+	static constexpr qint64 _checkpointDiskBudget = qint64(2) << 30;
+	Checkpoints _checkpoints;
+	GLuint _checkpointPBO[2];   // pixel buffers for reading checkpoints back, used in turn
+	int _checkpointPBOSize[2];
+	GLsync _checkpointFence[2]; // set while a readback is in flight
+	int _checkpointStep[2];     // step of the readback, or -1 if it is dropped
+	int _checkpointTime[2];
+	int _checkpointNext;
+	int _step;     // advection steps since the last restart
+	int _seekStep; // step to seek to at the next frame, or -1
+	bool _reversePlayback;
+	// Precomputed uniform meshes for all time cells
+	MeshBake _bake;
+	bool _useBake;
+	unsigned int _vaoBaked;
+	GLuint _bakedBuffers[3]; // positions, vertices, indices
+	unsigned int _indexCountBaked;
+	// Quads of the uniform mesh in stagnant regions are drawn from a static mesh
+	static constexpr float _staticThreshold = 0.1f; // pixels per step
+	FlowBounds _bounds;
+	bool _cullStatic;
+	unsigned int _vaoStatic;
+	GLuint _staticBuffers[2]; // vertices, indices
+	int _staticMeshSize;      // _nMesh of the static mesh, or 0
+	QVector<GLsizei> _staticCounts; // index ranges of the static quads of the current step
+	QVector<int> _staticFirsts;
+	// Finite-time Lyapunov exponent from composed flow maps
+	static constexpr int _ftleSlices = 64;
+	unsigned int _ftleTexture;
+	int _ftleTime;
+	float _ftleStepSize;
+	float _ftleMax;
+	// Parameters for the mesh
+	struct MeshVertex {
+		quint16 x, y; // position relative to the domain, with _meshMargin on each side
+		quint16 s, t; // texture coordinates
+	};
+	// The same in full precision for posters, where a packed step is a third of a pixel
+	struct PosterVertex {
+		float x, y;
+		float s, t;
+	};
+	static constexpr int _meshMargin = 8192; // in packed units, for vertices advected out of the domain
 	int _nMesh;
 	float _stepSize;
-	QMatrix4x4 _identity_matrix;
 	QMatrix4x4 _ortho_matrix;
 	// OpenGL objects
-	QVector<unsigned int> _texImages;
-	unsigned int _currentImage;
-	unsigned int _vertexArrayObject;
-	unsigned int _indexCount;
+	unsigned int _seedArray;   // all seed images, one per layer
+	int _seedLayers;
+	QVector<GLenum> _seedBlend; // per layer, the destination factor of blending it over the advected images
+	int _seedLayer;            // the current seed image
+	Cg::VertexArray _vertexArray; // the two triangles of a panel
 	unsigned int _vaoMesh;
+	GLuint _meshBuffers[2]; // vertices, indices
 	unsigned int _indexCountMesh;
 	unsigned int _vaoQuad;
+	GLuint _quadBuffers[2]; // vertices, indices
+	static constexpr int _maxTargets = 4;
 	GLuint _meshFB[2];
-	GLuint _meshTexture[2];
+	GLuint _meshTexture[2][_maxTargets]; // one texture per target, 0 if unused
+	int _targetCount;
 	QOpenGLShaderProgram _prg;
 	QOpenGLShaderProgram _prgMesh;
+	QOpenGLShaderProgram _prgAdvect;
+	QOpenGLShaderProgram _prgNoise;
+	GLuint _noiseFB;
+	GLuint _noiseTexture;
+	unsigned int _flowTexture;
+	unsigned int _transferFunction;
+	FlowRange _range;
+	int _flowTextureTime;
+	// Advection timing, averaged over 100 frames
+	typedef void (QOPENGLF_APIENTRYP GetQueryObjectui64v)(GLuint id, GLenum pname, GLuint64* params);
+	GetQueryObjectui64v _getQueryObjectui64v; // null without timer queries
+	GLuint _timerQueries[2];
+	int _timerQuery;
+	bool _timerQueryPending[2];
+	int _timerQuerySteps[2];
+	double _timingCPU;
+	double _timingGPU;
+	int _timingSteps;
+	int _timingFrames;
+	int _timingGPUSteps;
+	bool _timingReport; // print the averages, toggled with Key_O
+	// Line Integral Convolution
+	FlowLIC _lic;
+	QVector<QImage> _licNoise;
+	unsigned int _licTexture;
+	QSize _licTextureSize;
 
 	QVector2D getFlowVector(int t, int y, int x);
 	QVector2D getFlowVector(float x, float y, float t);
 	QVector2D heun(float stepSize, QVector2D position);
+	void advect(int steps);
 	void createMesh();
-	void fboTexResize();
+	void updateFlowTexture();
+	QVector<GLint> seedLayers() const;
+	void createSeedArray(QVector<QImage> images);
+	void renderNoise();
+	void resetTiming();
+	bool prepareBake();
+	MeshVertex packVertex(QVector2D position, float x, float y) const;
+	void appendVertex(QVector<MeshVertex>& vertices, QVector2D position, float x, float y) const;
+	void appendVertex(QVector<PosterVertex>& vertices, QVector2D position, float x, float y) const;
+	void setMeshVertexFormat();
+	void setPosterVertexFormat();
+	void setMeshVertexUniforms(QOpenGLShaderProgram& prg);
+	void linkMeshProgram(QOpenGLShaderProgram& prg, const QString& fragmentShaderFile);
+	template<class Vertex>
+	void buildMesh(int t, int nMesh, float stepSize, bool adaptive, QVector<Vertex>& vertices,
+		QVector<unsigned int>& indices, const QVector<bool>& staticQuads = QVector<bool>());
+	QVector<bool> findStaticQuads(int t) const;
+	void createStaticMesh();
+	template<class Vertex>
+	void appendAdaptiveMesh(int t, int nMesh, float stepSize, QVector<Vertex>& vertices,
+		QVector<unsigned int>& indices, float offset);
+	QSize wantedAdvectionSize(int w, int h) const;
+	void fboTexResize(int width, int height, int targetCount);
+	void updateLIC(int w, int h);
+	void updateFTLE();
+	void renderPoster(int width, const QString& filename);
+	void saveCheckpoint();
+	void fetchCheckpoints();
+	void clearCheckpoints();
+	bool seek(int step);
 
 public:
 	FlowVis();
@@ -1,5 +1,13 @@
 uniform sampler2D tex;
+// 0: RGBA texture, 1: scalar in [0, max_length], 2: signed scalar in [-max_length, max_length],
+// 3: magnitude of flow vectors in [min_length, max_length], mapped through transfer_function,
+// 4: layer seed_layer of seeds
+uniform int field_mode;
+uniform float min_length;
 uniform float max_length;
+uniform sampler2D transfer_function;
+uniform sampler2DArray seeds;
+uniform int seed_layer;
 
 smooth in vec2 vtexcoord;
 
@@ -7,13 +15,23 @@ layout(location = 0) out vec4 fcolor;
 
 void main(void)
 {
-	/*
-    float len = texture(tex, vtexcoord).r;
-    len /= max_length;
-    vec3 color = vec3(len, len, len);
-    fcolor = vec4(color, 1.0);
-	*/
-
-	// output the texture color (RGBA)
-    fcolor = vec4(texture(tex, vtexcoord));
+	if (field_mode == 1) {
+		float len = texture(tex, vtexcoord).r;
+		len /= max(max_length, 1e-6);
+		vec3 color = vec3(len, len, len);
+		fcolor = vec4(color, 1.0);
+	} else if (field_mode == 2) {
+		// red for positive and blue for negative values
+		float value = texture(tex, vtexcoord).r / max(max_length, 1e-6);
+		fcolor = vec4(max(value, 0.0), 0.0, max(-value, 0.0), 1.0);
+	} else if (field_mode == 3) {
+		float len = length(texture(tex, vtexcoord).rg);
+		float t = (len - min_length) / max(max_length - min_length, 1e-6);
+		fcolor = texture(transfer_function, vec2(clamp(t, 0.0, 1.0), 0.5));
+	} else if (field_mode == 4) {
+		fcolor = texture(seeds, vec3(vtexcoord, float(seed_layer)));
+	} else {
+		// output the texture color (RGBA)
+		fcolor = vec4(texture(tex, vtexcoord));
+	}
 }
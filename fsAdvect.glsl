@@ -0,0 +1,46 @@
+uniform sampler2D tex[4]; // previous advection results, one per color target
+uniform sampler2DArray seeds; // all seed images, one per layer
+uniform int seed_layer[4]; // per target the layer of seeds to read instead of tex, or -1
+uniform vec4 tile_rect;   // maps domain texture coordinates to those of tex: offset in xy, scale in zw
+uniform int target_count;
+uniform sampler2D flow;  // flow vectors of the current time slice, one texel per cell
+uniform vec2 cells;      // number of cells in x and y direction
+uniform float step_size;
+uniform float alpha;
+
+smooth in vec2 vtexcoord;
+
+layout(location = 0) out vec4 fcolor;
+layout(location = 1) out vec4 fcolor1;
+layout(location = 2) out vec4 fcolor2;
+layout(location = 3) out vec4 fcolor3;
+
+// Bilinearly interpolated flow vector at a position in cell units
+vec2 velocity(vec2 p)
+{
+	return texture(flow, (p + 0.5) / cells).rg;
+}
+
+vec3 source(int k, sampler2D t, vec2 texcoord)
+{
+	if (seed_layer[k] >= 0)
+		return texture(seeds, vec3(texcoord, float(seed_layer[k]))).rgb;
+	return texture(t, (texcoord - tile_rect.xy) * tile_rect.zw).rgb;
+}
+
+void main(void)
+{
+	// Trace the pixel backwards with a Heun step and fetch what was there
+	vec2 p = vtexcoord * cells;
+	vec2 v0 = velocity(p);
+	vec2 v1 = velocity(p - step_size * v0);
+	vec2 src = p - step_size * 0.5 * (v0 + v1);
+	// inflow at the borders repeats the border pixels, like the mesh border strip
+	src = clamp(src, vec2(0.0), cells) / cells;
+	fcolor = vec4(source(0, tex[0], src), alpha);
+	if (target_count > 1) {
+		fcolor1 = vec4(source(1, tex[1], src), alpha);
+		fcolor2 = vec4(source(2, tex[2], src), alpha);
+		fcolor3 = vec4(source(3, tex[3], src), alpha);
+	}
+}
@@ -1,12 +1,31 @@
-uniform sampler2D tex;
+uniform sampler2D tex[4]; // one texture per color target
+uniform sampler2DArray seeds; // all seed images, one per layer
+uniform int seed_layer[4]; // per target the layer of seeds to read instead of tex, or -1
+uniform vec4 tile_rect;   // maps domain texture coordinates to those of tex: offset in xy, scale in zw
+uniform int target_count;
 uniform float alpha;
 
 smooth in vec2 vtexcoord;
 
 layout(location = 0) out vec4 fcolor;
+layout(location = 1) out vec4 fcolor1;
+layout(location = 2) out vec4 fcolor2;
+layout(location = 3) out vec4 fcolor3;
+
+vec3 source(int k, sampler2D t, vec2 texcoord)
+{
+    if (seed_layer[k] >= 0)
+        return texture(seeds, vec3(texcoord, float(seed_layer[k]))).rgb;
+    return texture(t, (texcoord - tile_rect.xy) * tile_rect.zw).rgb;
+}
 
 void main(void)
 {
 	// output the texture color (RGBA)
-    fcolor = vec4(texture(tex, vtexcoord).rgb, alpha);
+    fcolor = vec4(source(0, tex[0], vtexcoord), alpha);
+    if (target_count > 1) {
+        fcolor1 = vec4(source(1, tex[1], vtexcoord), alpha);
+        fcolor2 = vec4(source(2, tex[2], vtexcoord), alpha);
+        fcolor3 = vec4(source(3, tex[3], vtexcoord), alpha);
+    }
 }
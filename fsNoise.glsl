@@ -0,0 +1,70 @@
+// Time-periodic noise for injection into the advected texture (IBFV):
+// every feature has a random phase, and its intensity follows a periodic
+// profile of the phase shifted by the time, so the noise changes smoothly
+// and repeats after one period.
+uniform vec2 resolution; // size of the target in pixels
+uniform float scale;     // feature size in pixels
+uniform float time;      // position in the period, in [0, 1)
+uniform uint seed;
+uniform int noise_type;  // 1: white, 2: Perlin, 3: spot
+
+smooth in vec2 vtexcoord;
+
+layout(location = 0) out vec4 fcolor;
+
+const float pi = 3.14159265358979;
+
+// Integer hash of a lattice point, mapped to [0, 1)
+float hash(ivec2 p)
+{
+	uint h = seed ^ (uint(p.x) * 0x8da6b343u) ^ (uint(p.y) * 0xd8163841u);
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return float(h >> 8) / 16777216.0;
+}
+
+// Band-limited gradient noise in about [-1, 1]
+float perlin(vec2 p)
+{
+	ivec2 i = ivec2(floor(p));
+	vec2 f = fract(p);
+	vec2 u = f * f * f * (f * (f * 6.0 - 15.0) + 10.0);
+	float a00 = 2.0 * pi * hash(i);
+	float a10 = 2.0 * pi * hash(i + ivec2(1, 0));
+	float a01 = 2.0 * pi * hash(i + ivec2(0, 1));
+	float a11 = 2.0 * pi * hash(i + ivec2(1, 1));
+	float n00 = dot(vec2(cos(a00), sin(a00)), f);
+	float n10 = dot(vec2(cos(a10), sin(a10)), f - vec2(1.0, 0.0));
+	float n01 = dot(vec2(cos(a01), sin(a01)), f - vec2(0.0, 1.0));
+	float n11 = dot(vec2(cos(a11), sin(a11)), f - vec2(1.0, 1.0));
+	return 1.4 * mix(mix(n00, n10, u.x), mix(n01, n11, u.x), u.y);
+}
+
+// Smooth periodic intensity profile of a phase
+float profile(float phase)
+{
+	return 0.5 + 0.5 * cos(2.0 * pi * phase);
+}
+
+void main(void)
+{
+	vec2 p = vtexcoord * resolution / scale;
+	float value;
+	if (noise_type == 2) {
+		// the phase varies smoothly in space, which keeps the noise band-limited
+		value = profile(time + 0.5 * perlin(p));
+	} else if (noise_type == 3) {
+		// one spot per lattice cell at a random position, pulsing with its own phase
+		ivec2 i = ivec2(floor(p));
+		vec2 center = vec2(i) + vec2(0.25) + 0.5 * vec2(hash(i), hash(i + ivec2(7919, 104729)));
+		float r = length(p - center) / 0.25;
+		float spot = max(1.0 - r * r, 0.0);
+		value = spot * profile(time + hash(i + ivec2(15485863, 0)));
+	} else {
+		value = step(0.5, fract(time + hash(ivec2(floor(p)))));
+	}
+	fcolor = vec4(vec3(value), 1.0);
+}
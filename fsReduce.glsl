@@ -0,0 +1,22 @@
+uniform sampler2D tex;
+uniform ivec2 input_size;
+// 1: the input holds flow vectors, 0: it holds minimum and maximum
+uniform int first_level;
+
+layout(location = 0) out vec4 fcolor;
+
+void main(void)
+{
+	// each output texel covers 2x2 input texels; at odd sizes the last
+	// row or column is read twice, which does not change the range
+	ivec2 p = 2 * ivec2(gl_FragCoord.xy);
+	vec2 range = vec2(3.4e38, -3.4e38);
+	for (int y = 0; y < 2; y++) {
+		for (int x = 0; x < 2; x++) {
+			vec4 v = texelFetch(tex, min(p + ivec2(x, y), input_size - 1), 0);
+			vec2 r = (first_level == 1) ? vec2(length(v.rg)) : v.rg;
+			range = vec2(min(range.x, r.x), max(range.y, r.y));
+		}
+	}
+	fcolor = vec4(range, 0.0, 1.0);
+}
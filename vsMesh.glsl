@@ -1,6 +1,8 @@
 uniform mat4 projection_matrix;
+uniform vec2 position_scale;  // unpacks normalized positions to cell units
+uniform vec2 position_offset;
 
-layout(location = 0) in vec3 pos;
+layout(location = 0) in vec2 pos;
 layout(location = 2) in vec2 texcoord;
 
 smooth out vec2 vtexcoord;
@@ -8,5 +10,5 @@ smooth out vec2 vtexcoord;
 void main(void)
 {
     vtexcoord = texcoord;
-    gl_Position = projection_matrix * vec4(pos, 1.0f);
+    gl_Position = projection_matrix * vec4(position_offset + position_scale * pos, 0.0f, 1.0f);
 }
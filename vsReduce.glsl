@@ -0,0 +1,6 @@
+void main(void)
+{
+    // one triangle that covers the whole viewport
+    vec2 pos = vec2(float((gl_VertexID & 1) * 4 - 1), float((gl_VertexID & 2) * 2 - 1));
+    gl_Position = vec4(pos, 0.0, 1.0);
+}